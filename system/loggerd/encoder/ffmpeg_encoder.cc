@@ -11,8 +11,6 @@
 
 #define __STDC_CONSTANT_MACROS
 
-#include "libyuv.h"
-
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
@@ -34,12 +32,6 @@ void FfmpegEncoder::encoder_init() {
   frame->linesize[1] = out_width/2;
   frame->linesize[2] = out_width/2;
 
-  convert_buf.resize(in_width * in_height * 3 / 2);
-
-  if (in_width != out_width || in_height != out_height) {
-    downscale_buf.resize(out_width * out_height * 3 / 2);
-  }
-
   publisher_init();
 }
 
@@ -57,17 +49,26 @@ void FfmpegEncoder::encoder_open(const char* path) {
   this->codec_ctx->height = frame->height;
   this->codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
   this->codec_ctx->time_base = (AVRational){ 1, fps };
+  // use all cores, the sim encodes three cameras in real time
+  this->codec_ctx->thread_count = 0;
+  this->codec_ctx->thread_type = FF_THREAD_SLICE | FF_THREAD_FRAME;
   int err = avcodec_open2(this->codec_ctx, codec, NULL);
   assert(err >= 0);
 
   is_open = true;
   segment_num++;
   counter = 0;
+  frame_counter = 0;
 }
 
 void FfmpegEncoder::encoder_close() {
   if (!is_open) return;
 
+  // the frames still in the frame threads belong to this segment
+  if (avcodec_send_frame(this->codec_ctx, NULL) == 0) {
+    receive_packets();
+  }
+  extras.clear();
   avcodec_free_context(&codec_ctx);
   is_open = false;
 }
@@ -76,75 +77,71 @@ int FfmpegEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) {
   assert(buf->width == this->in_width);
   assert(buf->height == this->in_height);
 
-  uint8_t *cy = convert_buf.data();
-  uint8_t *cu = cy + in_width * in_height;
-  uint8_t *cv = cu + (in_width / 2) * (in_height / 2);
-  libyuv::NV12ToI420(buf->y, buf->stride,
-                     buf->uv, buf->stride,
-                     cy, in_width,
-                     cu, in_width/2,
-                     cv, in_width/2,
-                     in_width, in_height);
-
-  if (downscale_buf.size() > 0) {
-    uint8_t *out_y = downscale_buf.data();
-    uint8_t *out_u = out_y + frame->width * frame->height;
-    uint8_t *out_v = out_u + (frame->width / 2) * (frame->height / 2);
-    libyuv::I420Scale(cy, in_width,
-                      cu, in_width/2,
-                      cv, in_width/2,
-                      in_width, in_height,
-                      out_y, frame->width,
-                      out_u, frame->width/2,
-                      out_v, frame->width/2,
-                      frame->width, frame->height,
-                      libyuv::kFilterNone);
-    frame->data[0] = out_y;
-    frame->data[1] = out_u;
-    frame->data[2] = out_v;
-  } else {
-    frame->data[0] = cy;
-    frame->data[1] = cu;
-    frame->data[2] = cv;
-  }
-  frame->pts = counter*50*1000; // 50ms per frame
+  // the conversion is shared with the other encoders of the camera
+  auto input = FramePreprocessor::camera(type).process(buf, *extra, frame->width, frame->height);
+  return encode_frame(input.get(), extra);
+}
+
+int FfmpegEncoder::encode_frame(YUVFrame *input, VisionIpcBufExtra *extra) {
+  assert(input->width == frame->width);
+  assert(input->height == frame->height);
+
+  frame->data[0] = input->y();
+  frame->data[1] = input->u();
+  frame->data[2] = input->v();
+  frame->pts = frame_counter*50*1000; // 50ms per frame
 
   int ret = counter;
 
+  // the encoder copies the frame, the input can be released
   int err = avcodec_send_frame(this->codec_ctx, frame);
   if (err < 0) {
     LOGE("avcodec_send_frame error %d", err);
+    return -1;
+  }
+  extras.push_back(*extra);
+  frame_counter++;
+
+  if (!receive_packets()) {
     ret = -1;
   }
+  return ret;
+}
 
+bool FfmpegEncoder::receive_packets() {
   AVPacket pkt;
   av_init_packet(&pkt);
   pkt.data = NULL;
   pkt.size = 0;
-  while (ret >= 0) {
-    err = avcodec_receive_packet(this->codec_ctx, &pkt);
+  bool ret = true;
+  while (true) {
+    int err = avcodec_receive_packet(this->codec_ctx, &pkt);
     if (err == AVERROR_EOF) {
       break;
     } else if (err == AVERROR(EAGAIN)) {
       // Encoder might need a few frames on startup to get started. Keep going
-      ret = 0;
       break;
     } else if (err < 0) {
       LOGE("avcodec_receive_packet error %d", err);
-      ret = -1;
+      ret = false;
       break;
     }
 
+    assert(!extras.empty());
+    VisionIpcBufExtra extra = extras.front();
+    extras.pop_front();
+
     if (env_debug_encoder) {
-      printf("%20s got %8d bytes flags %8x idx %4d id %8d\n", this->filename, pkt.size, pkt.flags, counter, extra->frame_id);
+      printf("%20s got %8d bytes flags %8x idx %4d id %8d\n", this->filename, pkt.size, pkt.flags, counter, extra.frame_id);
     }
 
-    publisher_publish(this, segment_num, counter, *extra,
+    publisher_publish(this, segment_num, counter, extra,
       (pkt.flags & AV_PKT_FLAG_KEY) ? V4L2_BUF_FLAG_KEYFRAME : 0,
       kj::arrayPtr<capnp::byte>(pkt.data, (size_t)0), // TODO: get the header
       kj::arrayPtr<capnp::byte>(pkt.data, pkt.size));
 
     counter++;
+    av_packet_unref(&pkt);
   }
   av_packet_unref(&pkt);
   return ret;
@@ -2,6 +2,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -12,6 +13,7 @@ extern "C" {
 }
 
 #include "system/loggerd/encoder/encoder.h"
+#include "system/loggerd/encoder/frame_preprocessor.h"
 #include "system/loggerd/loggerd.h"
 
 class FfmpegEncoder : public VideoEncoder {
@@ -24,16 +26,19 @@ class FfmpegEncoder : public VideoEncoder {
   ~FfmpegEncoder();
   void encoder_init();
   int encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra);
+  int encode_frame(YUVFrame *input, VisionIpcBufExtra *extra);
   void encoder_open(const char* path);
   void encoder_close();
 
 private:
+  bool receive_packets();
+
   int segment_num = -1;
-  int counter = 0;
+  int counter = 0;  // packets
+  int frame_counter = 0;
   bool is_open = false;
+  std::deque<VisionIpcBufExtra> extras;  // of the frames in the encoder, with frame threading packets come out later
 
   AVCodecContext *codec_ctx;
   AVFrame *frame = NULL;
-  std::vector<uint8_t> convert_buf;
-  std::vector<uint8_t> downscale_buf;
 };
@@ -0,0 +1,66 @@
+#include "system/loggerd/encoder/frame_preprocessor.h"
+
+#include <algorithm>
+
+#include "libyuv.h"
+
+FramePreprocessor &FramePreprocessor::camera(CameraType type) {
+  static FramePreprocessor preprocessors[WideRoadCam + 1];
+  return preprocessors[type];
+}
+
+std::shared_ptr<YUVFrame> FramePreprocessor::allocate(int width, int height) {
+  YUVFrame *f = nullptr;
+  {
+    std::lock_guard lk(pool->lock);
+    auto it = std::find_if(pool->free.begin(), pool->free.end(), [&](YUVFrame *free) { return free->width == width && free->height == height; });
+    if (it != pool->free.end()) {
+      f = *it;
+      pool->free.erase(it);
+    }
+  }
+  if (!f) {
+    f = new YUVFrame{.width = width, .height = height};
+    f->buf.resize(width * height * 3 / 2);
+  }
+  // the frame goes back to the pool when the last reference is released
+  return std::shared_ptr<YUVFrame>(f, [pool = pool](YUVFrame *released) {
+    std::lock_guard lk(pool->lock);
+    pool->free.push_back(released);
+  });
+}
+
+std::shared_ptr<YUVFrame> FramePreprocessor::process(VisionBuf *buf, const VisionIpcBufExtra &extra, int width, int height) {
+  std::lock_guard lk(lock);
+  if (!full || full->frame_id != extra.frame_id || full->timestamp_eof != extra.timestamp_eof) {
+    full = allocate(buf->width, buf->height);
+    full->frame_id = extra.frame_id;
+    full->timestamp_eof = extra.timestamp_eof;
+    libyuv::NV12ToI420(buf->y, buf->stride,
+                       buf->uv, buf->stride,
+                       full->y(), full->width,
+                       full->u(), full->width / 2,
+                       full->v(), full->width / 2,
+                       full->width, full->height);
+    scaled.clear();
+  }
+  if (width == full->width && height == full->height) return full;
+
+  for (auto &f : scaled) {
+    if (f->width == width && f->height == height) return f;
+  }
+  auto f = allocate(width, height);
+  f->frame_id = full->frame_id;
+  f->timestamp_eof = full->timestamp_eof;
+  libyuv::I420Scale(full->y(), full->width,
+                    full->u(), full->width / 2,
+                    full->v(), full->width / 2,
+                    full->width, full->height,
+                    f->y(), f->width,
+                    f->u(), f->width / 2,
+                    f->v(), f->width / 2,
+                    f->width, f->height,
+                    libyuv::kFilterNone);
+  scaled.push_back(f);
+  return f;
+}
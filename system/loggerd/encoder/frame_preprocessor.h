@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "cereal/visionipc/visionbuf.h"
+#include "cereal/visionipc/visionipc.h"
+#include "system/camerad/cameras/camera_common.h"
+
+// an I420 frame from the pool of a FramePreprocessor
+struct YUVFrame {
+  int width, height;
+  uint32_t frame_id;
+  uint64_t timestamp_eof;
+  std::vector<uint8_t> buf;
+
+  inline uint8_t *y() { return buf.data(); }
+  inline uint8_t *u() { return y() + width * height; }
+  inline uint8_t *v() { return u() + (width / 2) * (height / 2); }
+};
+
+// FramePreprocessor converts the NV12 camera frames for the software encoders of a camera.
+// each frame is converted once, and scaled once per output size, into pooled buffers that are
+// shared by the encoders and go back to the pool when the last encoder releases them.
+class FramePreprocessor {
+public:
+  FramePreprocessor() : pool(std::make_shared<Pool>()) {}
+  std::shared_ptr<YUVFrame> process(VisionBuf *buf, const VisionIpcBufExtra &extra, int width, int height);
+  static FramePreprocessor &camera(CameraType type);
+
+private:
+  struct Pool {
+    std::mutex lock;
+    std::vector<YUVFrame *> free;
+    ~Pool() { for (auto f : free) delete f; }
+  };
+  std::shared_ptr<YUVFrame> allocate(int width, int height);
+
+  std::mutex lock;
+  std::shared_ptr<Pool> pool;
+  std::shared_ptr<YUVFrame> full;  // the last camera frame at full size
+  std::vector<std::shared_ptr<YUVFrame>> scaled;  // and its scaled versions
+};
@@ -1,4 +1,7 @@
 #include "system/loggerd/loggerd.h"
+#include "common/queue.h"
+#include "common/statlog.h"
+#include "system/loggerd/encoder/frame_preprocessor.h"
 
 ExitHandler do_exit;
 
@@ -33,6 +36,105 @@ bool sync_encoders(EncoderdState *s, CameraType cam_type, uint32_t frame_id) {
   }
 }
 
+struct EncodeJob {
+  VisionBuf *buf;
+  VisionIpcBufExtra extra;
+  std::shared_ptr<YUVFrame> frame;  // the converted frame for the software encoders
+  bool rotate = false;
+  bool stop = false;
+};
+
+// the software encoders run on their own threads, fed by the receive stage through a bounded queue.
+// when an encoder falls behind the new frames are dropped for it and counted, the receive stage never waits.
+// the hardware encoder only queues the VisionBuf to the device, it runs in the receive stage before the buffer is reused.
+class EncoderWorker {
+public:
+  EncoderWorker(Encoder *encoder, const char *name) : encoder(encoder), name(name) {
+#ifndef QCOM2
+    thread = std::thread(&EncoderWorker::run, this);
+#endif
+  }
+  ~EncoderWorker() {
+    if (thread.joinable()) {
+      queue.push({.stop = true});
+      thread.join();
+    }
+  }
+
+  // single producer, the size only shrinks behind our back. a frame for a full queue is dropped
+  // before it is converted, push is only called when the queue is not full.
+  bool full() const {
+#ifdef QCOM2
+    return false;
+#else
+    return queue.size() >= ENCODER_QUEUE_SIZE;
+#endif
+  }
+
+  void drop(const EncodeJob &job) {
+    // the rotation is never dropped, it goes with the next frame
+    pending_rotate |= job.rotate;
+    dropped_frames++;
+    if (lagging++ == 0) LOGE("encoder %s falling behind, dropping frames", name);
+  }
+
+  void push(EncodeJob job) {
+    job.rotate |= std::exchange(pending_rotate, false);
+#ifdef QCOM2
+    encode(job);
+#else
+    if (lagging > 0) {
+      LOGW("encoder %s dropped %d frames", name, lagging);
+      lagging = 0;
+    }
+    queue.push(job);
+    high_water = std::max(high_water, queue.size());
+#endif
+  }
+
+  void publish_stats() {
+    statlog_gauge(util::string_format("encoderd_queue_high_water.%s", name).c_str(), (int)high_water);
+    statlog_gauge(util::string_format("encoderd_dropped_frames.%s", name).c_str(), (int)dropped_frames);
+    high_water = 0;
+    dropped_frames = 0;
+  }
+
+private:
+  void run() {
+    util::set_thread_name(name);
+    while (true) {
+      EncodeJob job = queue.pop();
+      if (job.stop) break;
+      encode(job);
+    }
+  }
+
+  void encode(EncodeJob &job) {
+    if (job.rotate) {
+      encoder->encoder_close();
+      encoder->encoder_open(NULL);
+    }
+#ifdef QCOM2
+    int out_id = encoder->encode_frame(job.buf, &job.extra);
+#else
+    int out_id = encoder->encode_frame(job.frame.get(), &job.extra);
+#endif
+    if (out_id == -1) {
+      LOGE("Failed to encode frame. frame_id: %d", job.extra.frame_id);
+    }
+  }
+
+  Encoder *encoder;
+  const char *name;
+  SafeQueue<EncodeJob> queue;
+  std::thread thread;
+
+  // only used by the receive stage
+  bool pending_rotate = false;
+  int lagging = 0;  // frames dropped in a row
+  uint64_t dropped_frames = 0;  // since the last stats
+  size_t high_water = 0;
+};
 
 void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
   util::set_thread_name(cam_info.thread_name);
@@ -71,6 +173,12 @@ void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
       encoders[i]->encoder_open(NULL);
     }
 
+    std::vector<std::unique_ptr<EncoderWorker>> workers;
+    for (int i = 0; i < encoders.size(); ++i) {
+      workers.emplace_back(new EncoderWorker(encoders[i], cam_info.encoder_infos[i].filename));
+    }
+
+    double last_stats_ts = millis_since_boot();
     bool lagging = false;
     while (!do_exit) {
       VisionIpcBufExtra extra;
@@ -92,25 +200,36 @@ void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
       }
       if (do_exit) break;
 
-      // do rotation if required
+      // do rotation if required, the encoders rotate before encoding the frame
       const int frames_per_seg = SEGMENT_LENGTH * MAIN_FPS;
+      bool rotate = false;
       if (cur_seg >= 0 && extra.frame_id >= ((cur_seg + 1) * frames_per_seg) + s->start_frame_id) {
-        for (auto &e : encoders) {
-          e->encoder_close();
-          e->encoder_open(NULL);
-        }
+        rotate = true;
         ++cur_seg;
       }
 
       // encode a frame
       for (int i = 0; i < encoders.size(); ++i) {
-        int out_id = encoders[i]->encode_frame(buf, &extra);
-
-        if (out_id == -1) {
-          LOGE("Failed to encode frame. frame_id: %d", extra.frame_id);
+        EncodeJob job = {.buf = buf, .extra = extra, .rotate = rotate};
+        if (workers[i]->full()) {
+          workers[i]->drop(job);
+          continue;
         }
+#ifndef QCOM2
+        // convert before the VisionBuf is reused, the conversion is shared by the encoders of the camera
+        const auto &info = cam_info.encoder_infos[i];
+        job.frame = FramePreprocessor::camera(cam_info.type).process(buf, extra, info.frame_width, info.frame_height);
+#endif
+        workers[i]->push(job);
+      }
+
+      if (double tms = millis_since_boot(); tms - last_stats_ts > STATS_INTERVAL_MS) {
+        for (auto &w : workers) w->publish_stats();
+        last_stats_ts = tms;
       }
     }
+    // finish the queued frames before closing the encoders
+    workers.clear();
   }
 
   LOG("encoder destroy");
@@ -1,9 +1,14 @@
 #include "system/loggerd/logger.h"
 
+#include <fcntl.h>
+#include <limits.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <ftw.h>
 
+#include <bzlib.h>
+
 #include <cassert>
 #include <cerrno>
 #include <cstdint>
@@ -17,8 +22,216 @@
 
 #include "common/params.h"
 #include "common/swaglog.h"
+#include "common/timing.h"
 #include "common/version.h"
 
+// ***** raw file *****
+
+LatencyHistogram::Counts LatencyHistogram::take() {
+  Counts ret;
+  for (int i = 0; i < BUCKETS; ++i) {
+    ret[i] = counts[i].exchange(0);
+  }
+  return ret;
+}
+
+uint64_t LatencyHistogram::percentile(const Counts &counts, double p) {
+  uint64_t total = 0;
+  for (auto c : counts) total += c;
+  if (total == 0) return 0;
+
+  uint64_t rank = std::max<uint64_t>(1, p * total + 0.5), sum = 0;
+  for (int i = 0; i < BUCKETS; ++i) {
+    sum += counts[i];
+    if (sum >= rank) return 1ULL << i;
+  }
+  return 1ULL << (BUCKETS - 1);
+}
+
+static std::string compress_bz2(const std::string &in) {
+  // the worst case size from the bzip2 manual
+  unsigned int size = in.size() + in.size() / 100 + 600;
+  std::string out(size, '\0');
+  int ret = BZ2_bzBuffToBuffCompress(out.data(), &size, (char *)in.data(), in.size(), RAWFILE_BZ2_BLOCK_SIZE, 0, 0);
+  assert(ret == BZ_OK);
+  out.resize(size);
+  return out;
+}
+
+RawFile::RawFile(const char* path, bool compress, StreamCallback stream_written)
+    : path(path), compress(compress), buffer_size(compress ? RAWFILE_STREAM_SIZE : RAWFILE_BUFFER_SIZE),
+      stream_written(std::move(stream_written)) {
+  fd = HANDLE_EINTR(open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666));
+  assert(fd != -1);
+  prealloc = std::make_unique<FilePreallocator>(fd, this->path);
+  io_thread = std::thread(&RawFile::ioThread, this);
+}
+
+RawFile::~RawFile() {
+  {
+    std::lock_guard lk(lock);
+    exit = true;
+  }
+  io_cv.notify_one();
+  io_thread.join();
+  prealloc.reset();
+  int err = close(fd);
+  assert(err == 0);
+}
+
+void RawFile::write(void* data, size_t size) {
+  std::unique_lock lk(lock);
+  if (buffered > 0 && buffered + size > RAWFILE_MAX_BUFFERED) {
+    stats.stalls++;
+    space_cv.wait(lk, [&]() { return buffered == 0 || buffered + size <= RAWFILE_MAX_BUFFERED; });
+  }
+
+  const char *p = (const char *)data;
+  buffered += size;
+  while (size > 0) {
+    if (cur.capacity() < buffer_size) {
+      if (!free_buffers.empty()) {
+        cur = std::move(free_buffers.back());
+        free_buffers.pop_back();
+      } else {
+        cur.reserve(buffer_size);
+      }
+    }
+    // compressed files never split a write across buffers
+    const size_t n = compress ? size : std::min(size, buffer_size - cur.size());
+    if (compress && !cur.empty() && cur.size() + n > buffer_size) {
+      pending.push_back(std::move(cur));
+      cur = std::string();
+      io_cv.notify_one();
+      continue;
+    }
+    if (cur.empty()) cur_started_ns = nanos_since_boot();
+    cur.append(p, n);
+    p += n;
+    size -= n;
+    if (cur.size() >= buffer_size) {
+      pending.push_back(std::move(cur));
+      cur = std::string();
+      io_cv.notify_one();
+    }
+  }
+
+  size_t high_water = stats.buffered_high_water;
+  while (buffered > high_water && !stats.buffered_high_water.compare_exchange_weak(high_water, buffered)) {}
+}
+
+void RawFile::ioThread() {
+  util::set_thread_name("loggerd_io");
+  const uint64_t max_age_ns = (compress ? RAWFILE_STREAM_MAX_MS : 0) * 1000000ULL;
+  std::vector<std::string> batch;
+  std::unique_lock lk(lock);
+  while (true) {
+    io_cv.wait_for(lk, std::chrono::milliseconds(RAWFILE_FLUSH_MS), [&]() { return !pending.empty() || exit; });
+    // also take the partially filled buffer, so the data reaches the file in time.
+    // a compressed stream is only cut short once its data is old enough.
+    if (!cur.empty() && (exit || nanos_since_boot() - cur_started_ns >= max_age_ns)) {
+      pending.push_back(std::move(cur));
+      cur = std::string();
+    }
+    if (pending.empty()) {
+      if (exit) break;
+      continue;
+    }
+
+    batch.assign(std::make_move_iterator(pending.begin()), std::make_move_iterator(pending.end()));
+    pending.clear();
+    lk.unlock();
+    const size_t written = writeBatch(batch);
+    lk.lock();
+
+    buffered -= written;
+    for (auto &b : batch) {
+      if (free_buffers.size() < 4 && b.capacity() >= buffer_size) {
+        b.clear();
+        free_buffers.push_back(std::move(b));
+      }
+    }
+    batch.clear();
+    space_cv.notify_all();
+  }
+}
+
+// returns the number of bytes taken from the batch
+size_t RawFile::writeBatch(std::vector<std::string> &batch) {
+  size_t batch_size = 0;
+  std::vector<std::string> compressed;
+  for (auto &b : batch) {
+    batch_size += b.size();
+    if (compress) compressed.push_back(compress_bz2(b));
+  }
+
+  std::vector<iovec> iov;
+  size_t total = 0;
+  for (auto &b : compress ? compressed : batch) {
+    iov.push_back({.iov_base = b.data(), .iov_len = b.size()});
+    total += b.size();
+  }
+
+  const uint64_t start_ts = nanos_since_boot();
+  prealloc->reserve(offset + total);
+  size_t written = 0, i = 0;
+  while (written < total) {
+    ssize_t ret = HANDLE_EINTR(pwritev(fd, &iov[i], std::min<int>(iov.size() - i, IOV_MAX), offset + written));
+    if (ret <= 0) {
+      LOGE("failed to write %s: %s", path.c_str(), strerror(errno));
+      assert(0);
+    }
+    written += ret;
+    // skip the written part of the batch
+    for (; ret > 0 && i < iov.size(); ++i) {
+      if ((size_t)ret < iov[i].iov_len) {
+        iov[i].iov_base = (char *)iov[i].iov_base + ret;
+        iov[i].iov_len -= ret;
+        break;
+      }
+      ret -= iov[i].iov_len;
+    }
+  }
+  offset += total;
+  prealloc->written(offset);
+  stats.write_latency.add((nanos_since_boot() - start_ts) / 1000);
+
+  if (stream_written) {
+    size_t file_offset = offset - total;
+    for (size_t j = 0; j < compressed.size(); ++j) {
+      stream_written(raw_offset, file_offset, compressed[j].size());
+      raw_offset += batch[j].size();
+      file_offset += compressed[j].size();
+    }
+  }
+  return batch_size;
+}
+
+LogFile::LogFile(const char *path, const char *index_path, bool compress) : index(index_path) {
+  LogIndexHeader header = {.version = LOG_INDEX_VERSION};
+  memcpy(header.magic, LOG_INDEX_MAGIC, sizeof(header.magic));
+  index.write(&header, sizeof(header));
+
+  log = std::make_unique<RawFile>(path, compress, [this](size_t offset, size_t file_offset, size_t file_size) {
+    LogIndexStream stream = {.offset = offset, .file_offset = file_offset, .file_size = (uint32_t)file_size, .which = LOG_INDEX_STREAM};
+    index.write(&stream, sizeof(stream));
+  });
+}
+
+LogFile::~LogFile() {
+  log.reset();
+  LogIndexEntry end = {.offset = offset, .mono_time = count, .size = 0, .which = LOG_INDEX_END};
+  index.write(&end, sizeof(end));
+}
+
+void LogFile::write(uint8_t *data, size_t size, uint16_t which, uint64_t mono_time) {
+  LogIndexEntry entry = {.offset = offset, .mono_time = mono_time, .size = (uint32_t)size, .which = which};
+  log->write(data, size);
+  index.write(&entry, sizeof(entry));
+  offset += size;
+  count++;
+}
+
 // ***** log metadata *****
 kj::Array<capnp::word> logger_build_init_data() {
   MessageBuilder msg;
@@ -102,11 +315,167 @@ std::string logger_get_route_name() {
   return route_name;
 }
 
-void log_init_data(LoggerState *s) {
-  auto bytes = s->init_data.asBytes();
-  logger_log(s, bytes.begin(), bytes.size(), s->has_qlog);
+// ***** log thread *****
+
+LogRecord *LogRecord::create(Type type, LoggerHandle *h, const uint8_t *data, size_t size, bool in_qlog) {
+  static_assert(sizeof(LogRecord) % sizeof(capnp::word) == 0, "the data must stay word aligned");
+  LogRecord *r = new (malloc(sizeof(LogRecord) + size)) LogRecord();
+  r->type = type;
+  r->h = h;
+  r->epoch = h ? h->epoch.load(std::memory_order_acquire) : -1;
+  r->size = size;
+  r->in_qlog = in_qlog;
+  if (size > 0) {
+    memcpy(r->data(), data, size);
+  }
+  return r;
+}
+
+void LogRecord::destroy(LogRecord *r) {
+  r->~LogRecord();
+  free(r);
+}
+
+void LogQueue::push(LogRecord *r) {
+  r->next.store(nullptr, std::memory_order_relaxed);
+  LogRecord *prev = head.exchange(r, std::memory_order_acq_rel);
+  prev->next.store(r, std::memory_order_release);
+}
+
+LogRecord *LogQueue::pop() {
+  LogRecord *t = tail;
+  LogRecord *next = t->next.load(std::memory_order_acquire);
+  if (t == &stub) {
+    if (!next) return nullptr;
+    tail = t = next;
+    next = next->next.load(std::memory_order_acquire);
+  }
+  if (next) {
+    tail = next;
+    return t;
+  }
+  if (t != head.load(std::memory_order_acquire)) return nullptr;
+
+  // t is the last record, put the stub behind it so it can be taken
+  push(&stub);
+  next = t->next.load(std::memory_order_acquire);
+  if (next) {
+    tail = next;
+    return t;
+  }
+  return nullptr;
+}
+
+static void push_record(LoggerState *s, LogRecord *r) {
+  // the log thread only falls behind when RawFile::write waits for the storage, bound the memory
+  // by waiting as well. records without data never wait, closing a segment can't block.
+  if (r->size > 0) {
+    size_t queued = s->queued_bytes;
+    if (queued > 0 && queued + r->size > LOGGER_MAX_QUEUED) {
+      RawFile::stats.queue_stalls++;
+      std::unique_lock lk(s->space_lock);
+      s->space_waiters++;
+      s->space_cv.wait(lk, [&]() {
+        queued = s->queued_bytes;
+        return queued == 0 || queued + r->size <= LOGGER_MAX_QUEUED;
+      });
+      s->space_waiters--;
+    }
+    s->queued_bytes += r->size;
+  }
+  s->queue.push(r);
+  sem_post(&s->queued);
+}
+
+static void release_record(LoggerState *s, LogRecord *r) {
+  if (r->size > 0) {
+    s->queued_bytes -= r->size;
+    if (s->space_waiters > 0) {
+      // take the lock so a waiter can't miss the notification between its check and its wait
+      std::lock_guard lk(s->space_lock);
+      s->space_cv.notify_all();
+    }
+  }
+  LogRecord::destroy(r);
 }
 
+static void write_record(LoggerHandle *h, uint8_t *data, size_t size, bool in_qlog) {
+  // the record data is word aligned, read the index fields in place
+  uint16_t which = LOG_INDEX_INVALID;
+  uint64_t mono_time = 0;
+  try {
+    capnp::FlatArrayMessageReader reader(kj::ArrayPtr<const capnp::word>((const capnp::word *)data, size / sizeof(capnp::word)));
+    auto event = reader.getRoot<cereal::Event>();
+    which = event.which();
+    mono_time = event.getLogMonoTime();
+  } catch (const kj::Exception &e) {
+    LOGW("failed to index message of size %zu", size);
+  }
+
+  h->log->write(data, size, which, mono_time);
+  if (in_qlog && h->q_log) {
+    h->q_log->write(data, size, which, mono_time);
+  }
+}
+
+static void close_handle(LoggerHandle *h) {
+  // all references are released, the sentinel is the last message of the segment
+  MessageBuilder msg;
+  auto sen = msg.initEvent().initSentinel();
+  sen.setType(h->end_sentinel_type);
+  sen.setSignal(h->exit_signal);
+  auto bytes = msg.toBytes();
+  write_record(h, bytes.begin(), bytes.size(), true);
+
+  h->log.reset(nullptr);
+  h->q_log.reset(nullptr);
+  unlink(h->lock_path);
+  h->epoch.store(-1, std::memory_order_release);
+  h->in_use.store(false, std::memory_order_release);
+}
+
+static void logger_thread(LoggerState *s) {
+  util::set_thread_name("loggerd_log");
+  LoggerHandle *current = nullptr;  // the newest open segment
+  while (true) {
+    while (HANDLE_EINTR(sem_wait(&s->queued)) != 0) {}
+    LogRecord *r = nullptr;
+    while (!(r = s->queue.pop())) {
+      // a writer is between the two steps of its push
+      std::this_thread::yield();
+    }
+
+    LoggerHandle *h = r->h;
+    if (r->type == LogRecord::Type::LOG) {
+      if (r->epoch >= 0 && r->epoch == h->epoch.load(std::memory_order_acquire)) {
+        if (!current || h->epoch > current->epoch) current = h;
+      } else {
+        // logger_log raced with a rotation and the segment is already closed, log to the current one.
+        h = current;
+      }
+      if (h) {
+        write_record(h, r->data(), r->size, r->in_qlog);
+      }
+    } else if (r->type == LogRecord::Type::CLOSE) {
+      close_handle(h);
+      if (current == h) current = nullptr;
+    } else if (r->type == LogRecord::Type::FLUSH) {
+      r->flushed->set_value();
+    } else if (r->type == LogRecord::Type::STOP) {
+      release_record(s, r);
+      break;
+    }
+    release_record(s, r);
+  }
+}
+
+LoggerState::~LoggerState() {
+  if (log_thread.joinable()) {
+    push_record(this, LogRecord::create(LogRecord::Type::STOP, nullptr));
+    log_thread.join();
+    sem_destroy(&queued);
+  }
+}
 
 static void lh_log_sentinel(LoggerHandle *h, SentinelType type) {
   MessageBuilder msg;
@@ -120,31 +489,40 @@ static void lh_log_sentinel(LoggerHandle *h, SentinelType type) {
 
 // ***** logging functions *****
 
-void logger_init(LoggerState *s, bool has_qlog) {
-  pthread_mutex_init(&s->lock, NULL);
-
+void logger_init(LoggerState *s, bool has_qlog, bool compress) {
   s->part = -1;
   s->has_qlog = has_qlog;
+  s->compress = compress;
   s->route_name = logger_get_route_name();
   s->init_data = logger_build_init_data();
+
+  int err = sem_init(&s->queued, 0, 0);
+  assert(err == 0);
+  s->log_thread = std::thread(logger_thread, s);
 }
 
 static LoggerHandle* logger_open(LoggerState *s, const char* root_path) {
+  // the log thread frees the slots after writing the closed segments
   LoggerHandle *h = NULL;
-  for (int i=0; i<LOGGER_MAX_HANDLES; i++) {
-    if (s->handles[i].refcnt == 0) {
-      h = &s->handles[i];
-      break;
+  for (int retry = 0; !h && retry < 10000; ++retry) {
+    for (int i=0; i<LOGGER_MAX_HANDLES; i++) {
+      if (!s->handles[i].in_use.load(std::memory_order_acquire)) {
+        h = &s->handles[i];
+        break;
+      }
     }
+    if (!h) util::sleep_for(1);
   }
   assert(h);
 
   snprintf(h->segment_path, sizeof(h->segment_path),
           "%s/%s--%d", root_path, s->route_name.c_str(), s->part);
 
-  snprintf(h->log_path, sizeof(h->log_path), "%s/rlog", h->segment_path);
-  snprintf(h->qlog_path, sizeof(h->qlog_path), "%s/qlog", h->segment_path);
+  const char *ext = s->compress ? ".bz2" : "";
+  snprintf(h->log_path, sizeof(h->log_path), "%s/rlog%s", h->segment_path, ext);
+  snprintf(h->qlog_path, sizeof(h->qlog_path), "%s/qlog%s", h->segment_path, ext);
   snprintf(h->lock_path, sizeof(h->lock_path), "%s.lock", h->log_path);
+  h->logger = s;
   h->end_sentinel_type = SentinelType::END_OF_SEGMENT;
   h->exit_signal = 0;
 
@@ -154,34 +532,38 @@ static LoggerHandle* logger_open(LoggerState *s, const char* root_path) {
   if (lock_file == NULL) return NULL;
   fclose(lock_file);
 
-  h->log = std::make_unique<RawFile>(h->log_path);
+  char index_path[4096];
+  snprintf(index_path, sizeof(index_path), "%s/rlog.idx", h->segment_path);
+  h->log = std::make_unique<LogFile>(h->log_path, index_path, s->compress);
   if (s->has_qlog) {
-    h->q_log = std::make_unique<RawFile>(h->qlog_path);
+    snprintf(index_path, sizeof(index_path), "%s/qlog.idx", h->segment_path);
+    h->q_log = std::make_unique<LogFile>(h->qlog_path, index_path, s->compress);
   }
 
-  pthread_mutex_init(&h->lock, NULL);
-  h->refcnt++;
+  h->in_use = true;
+  h->refcnt = 1;
+  h->epoch.store(s->part, std::memory_order_release);
   return h;
 }
 
 int logger_next(LoggerState *s, const char* root_path,
                             char* out_segment_path, size_t out_segment_path_len,
                             int* out_part) {
-  bool is_start_of_route = !s->cur_handle;
-
-  pthread_mutex_lock(&s->lock);
+  LoggerHandle *prev_h = s->cur_handle;
   s->part++;
 
   LoggerHandle* next_h = logger_open(s, root_path);
-  if (!next_h) {
-    pthread_mutex_unlock(&s->lock);
-    return -1;
-  }
+  if (!next_h) return -1;
+
+  // write beginning of log metadata before any writer can see the new segment
+  auto bytes = s->init_data.asBytes();
+  lh_log(next_h, bytes.begin(), bytes.size(), s->has_qlog);
+  lh_log_sentinel(next_h, prev_h ? SentinelType::START_OF_SEGMENT : SentinelType::START_OF_ROUTE);
 
-  if (s->cur_handle) {
-    lh_close(s->cur_handle);
-  }
   s->cur_handle = next_h;
+  if (prev_h) {
+    lh_close(prev_h);
+  }
 
   if (out_segment_path) {
     snprintf(out_segment_path, out_segment_path_len, "%s", next_h->segment_path);
@@ -189,72 +571,55 @@ int logger_next(LoggerState *s, const char* root_path,
   if (out_part) {
     *out_part = s->part;
   }
-
-  pthread_mutex_unlock(&s->lock);
-
-  // write beginning of log metadata
-  log_init_data(s);
-  lh_log_sentinel(s->cur_handle, is_start_of_route ? SentinelType::START_OF_ROUTE : SentinelType::START_OF_SEGMENT);
   return 0;
 }
 
 LoggerHandle* logger_get_handle(LoggerState *s) {
-  pthread_mutex_lock(&s->lock);
-  LoggerHandle* h = s->cur_handle;
-  if (h) {
-    pthread_mutex_lock(&h->lock);
-    h->refcnt++;
-    pthread_mutex_unlock(&h->lock);
-  }
-  pthread_mutex_unlock(&s->lock);
-  return h;
+  while (true) {
+    LoggerHandle* h = s->cur_handle;
+    if (!h) return nullptr;
+
+    // only take a reference while the handle is open
+    int cnt = h->refcnt.load();
+    while (cnt > 0 && !h->refcnt.compare_exchange_weak(cnt, cnt + 1)) {}
+    if (cnt > 0) return h;
+    if (s->cur_handle == h) return nullptr;  // the logger is closed
+  }
 }
 
 void logger_log(LoggerState *s, uint8_t* data, size_t data_size, bool in_qlog) {
-  pthread_mutex_lock(&s->lock);
-  if (s->cur_handle) {
-    lh_log(s->cur_handle, data, data_size, in_qlog);
+  if (LoggerHandle *h = s->cur_handle) {
+    push_record(s, LogRecord::create(LogRecord::Type::LOG, h, data, data_size, in_qlog));
   }
-  pthread_mutex_unlock(&s->lock);
 }
 
 void logger_close(LoggerState *s, ExitHandler *exit_handler) {
-  pthread_mutex_lock(&s->lock);
-  if (s->cur_handle) {
-    s->cur_handle->exit_signal = exit_handler && exit_handler->signal.load();
-    s->cur_handle->end_sentinel_type = SentinelType::END_OF_ROUTE;
-    lh_close(s->cur_handle);
+  if (LoggerHandle *h = s->cur_handle) {
+    h->exit_signal = exit_handler && exit_handler->signal.load();
+    h->end_sentinel_type = SentinelType::END_OF_ROUTE;
+    lh_close(h);
   }
-  pthread_mutex_unlock(&s->lock);
+  logger_flush(s);
+}
+
+void logger_flush(LoggerState *s) {
+  std::promise<void> flushed;
+  LogRecord *r = LogRecord::create(LogRecord::Type::FLUSH, nullptr);
+  r->flushed = &flushed;
+  push_record(s, r);
+  flushed.get_future().wait();
 }
 
 void lh_log(LoggerHandle* h, uint8_t* data, size_t data_size, bool in_qlog) {
-  pthread_mutex_lock(&h->lock);
   assert(h->refcnt > 0);
-  h->log->write(data, data_size);
-  if (in_qlog && h->q_log) {
-    h->q_log->write(data, data_size);
-  }
-  pthread_mutex_unlock(&h->lock);
+  push_record(h->logger, LogRecord::create(LogRecord::Type::LOG, h, data, data_size, in_qlog));
 }
 
 void lh_close(LoggerHandle* h) {
-  pthread_mutex_lock(&h->lock);
-  assert(h->refcnt > 0);
-  if (h->refcnt == 1) {
-    // a very ugly hack. only here can guarantee sentinel is the last msg
-    pthread_mutex_unlock(&h->lock);
-    lh_log_sentinel(h, h->end_sentinel_type);
-    pthread_mutex_lock(&h->lock);
-  }
-  h->refcnt--;
-  if (h->refcnt == 0) {
-    h->log.reset(nullptr);
-    h->q_log.reset(nullptr);
-    unlink(h->lock_path);
-    pthread_mutex_unlock(&h->lock);
-    pthread_mutex_destroy(&h->lock);
-    return;
-  }
-  pthread_mutex_unlock(&h->lock);
+  int cnt = h->refcnt.fetch_sub(1);
+  assert(cnt > 0);
+  if (cnt == 1) {
+    // records are ordered, the sentinel is written after everything the holders logged
+    push_record(h->logger, LogRecord::create(LogRecord::Type::CLOSE, h));
+  }
 }
@@ -1,11 +1,23 @@
 #pragma once
 
 #include <cassert>
-#include <pthread.h>
+#include <semaphore.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <capnp/serialize.h>
 #include <kj/array.h>
@@ -14,66 +26,213 @@
 #include "common/util.h"
 #include "common/swaglog.h"
 #include "system/hardware/hw.h"
+#include "system/loggerd/preallocator.h"
 
 const std::string LOG_ROOT = Path::log_root();
 
 #define LOGGER_MAX_HANDLES 16
+const size_t LOGGER_MAX_QUEUED = 64 * 1024 * 1024;  // writers wait when the log thread falls this far behind
 
+const size_t RAWFILE_BUFFER_SIZE = 1024 * 1024;
+const size_t RAWFILE_MAX_BUFFERED = 64 * 1024 * 1024;  // writers wait when the storage falls this far behind
+const int RAWFILE_FLUSH_MS = 100;  // the longest time data stays in memory
+// compressed files start a new bz2 stream once this much data is buffered, or when the oldest
+// data is RAWFILE_STREAM_MAX_MS old. small streams compress poorly, a low rate qlog hits the time bound.
+const size_t RAWFILE_STREAM_SIZE = 512 * 1024;
+const int RAWFILE_STREAM_MAX_MS = 5000;
+const int RAWFILE_BZ2_BLOCK_SIZE = 2;  // in units of 100k, a 900k block is larger than a stream
+
+// latencies in power of two microsecond buckets, bucket i counts [2^(i-1), 2^i) us.
+struct LatencyHistogram {
+  static constexpr int BUCKETS = 24;
+  typedef std::array<uint64_t, BUCKETS> Counts;
+
+  inline void add(uint64_t us) { counts[std::min(BUCKETS - 1, us == 0 ? 0 : 64 - __builtin_clzll(us))]++; }
+  Counts take();  // returns the counts and resets them
+  static uint64_t percentile(const Counts &counts, double p);  // upper bound of the bucket in us
+
+  std::array<std::atomic<uint64_t>, BUCKETS> counts = {};
+};
+
+struct WriteStats {
+  std::atomic<size_t> buffered_high_water = 0;
+  std::atomic<uint64_t> stalls = 0;  // writes that waited for the I/O thread
+  std::atomic<uint64_t> queue_stalls = 0;  // messages that waited for the log thread
+  LatencyHistogram write_latency;
+};
+
+// RawFile buffers the writes in memory and writes them to the file from its own I/O thread,
+// the callers only copy the data and never wait for the storage unless the buffers are full.
+// compressed files are a sequence of bz2 streams that each hold whole writes, so the streams
+// end at message boundaries and a crash only loses the last stream.
 class RawFile {
  public:
-  RawFile(const char* path) {
-    file = util::safe_fopen(path, "wb");
-    assert(file != nullptr);
-  }
-  ~RawFile() {
-    util::safe_fflush(file);
-    int err = fclose(file);
-    assert(err == 0);
-  }
-  inline void write(void* data, size_t size) {
-    int written = util::safe_fwrite(data, 1, size, file);
-    assert(written == size);
-  }
+  // called from the I/O thread after each compressed stream is written, with the position
+  // of its data in the uncompressed file and its position and size in the file.
+  typedef std::function<void(size_t offset, size_t file_offset, size_t file_size)> StreamCallback;
+
+  RawFile(const char* path, bool compress = false, StreamCallback stream_written = nullptr);
+  ~RawFile();  // writes all buffered data
+  void write(void* data, size_t size);
   inline void write(kj::ArrayPtr<capnp::byte> array) { write(array.begin(), array.size()); }
 
+  static inline WriteStats stats;  // shared by all files, published by loggerd
+
  private:
-  FILE* file = nullptr;
+  void ioThread();
+  size_t writeBatch(std::vector<std::string> &batch);
+
+  const std::string path;
+  const bool compress;
+  const size_t buffer_size;  // a compressed buffer is one bz2 stream
+  const StreamCallback stream_written;
+  int fd = -1;
+  size_t offset = 0, raw_offset = 0;  // only used by the I/O thread
+  std::unique_ptr<FilePreallocator> prealloc;  // only used by the I/O thread
+
+  std::mutex lock;
+  std::condition_variable io_cv, space_cv;
+  std::string cur;  // the buffer being filled
+  uint64_t cur_started_ns = 0;  // when the first write went into cur
+  std::deque<std::string> pending;  // full buffers waiting for the I/O thread
+  std::vector<std::string> free_buffers;
+  size_t buffered = 0;  // bytes in cur and pending
+  bool exit = false;
+  std::thread io_thread;
+};
+
+// every log has an index next to it ("rlog.idx", "qlog.idx") to seek and filter the messages without parsing the log,
+// the offsets are into the uncompressed log. the index is a LogIndexHeader followed by one LogIndexEntry per message.
+// when the segment is closed an entry with which == LOG_INDEX_END is appended, its offset is the size of the log and
+// mono_time the number of messages. an index without it was cut short, but all complete entries are valid.
+// a compressed log also has a LogIndexStream per bz2 stream, in the order of the streams but interleaved with the
+// messages. a stream holds whole messages, a message is read by decompressing the last stream that starts at or
+// before its offset.
+const char LOG_INDEX_MAGIC[4] = {'L', 'I', 'D', 'X'};
+const uint32_t LOG_INDEX_VERSION = 2;
+const uint16_t LOG_INDEX_END = 0xffff;
+const uint16_t LOG_INDEX_INVALID = 0xfffe;  // the message could not be parsed
+const uint16_t LOG_INDEX_STREAM = 0xfffd;
+
+struct LogIndexHeader {
+  char magic[4];
+  uint32_t version;
+};
+
+struct LogIndexEntry {
+  uint64_t offset;
+  uint64_t mono_time;
+  uint32_t size;
+  uint16_t which;  // cereal::Event::Which
+  uint16_t reserved;
+};
+static_assert(sizeof(LogIndexEntry) == 24);
+
+struct LogIndexStream {
+  uint64_t offset;  // where the data of the stream starts in the uncompressed log
+  uint64_t file_offset;
+  uint32_t file_size;
+  uint16_t which;  // LOG_INDEX_STREAM
+  uint16_t reserved;
+};
+static_assert(sizeof(LogIndexStream) == sizeof(LogIndexEntry) && offsetof(LogIndexStream, which) == offsetof(LogIndexEntry, which));
+
+// a log and its index
+class LogFile {
+ public:
+  LogFile(const char *path, const char *index_path, bool compress);
+  ~LogFile();  // finalizes the index
+  void write(uint8_t *data, size_t size, uint16_t which, uint64_t mono_time);
+
+ private:
+  RawFile index;
+  std::unique_ptr<RawFile> log;  // closed before the end entry, so all its streams are in the index
+  uint64_t offset = 0, count = 0;
 };
 
 typedef cereal::Sentinel::SentinelType SentinelType;
 
+struct LoggerState;
+struct LoggerHandle;
+
+// a message for the log thread, the data follows the record in the same allocation.
+struct LogRecord {
+  enum class Type : uint8_t { LOG, CLOSE, FLUSH, STOP };
+
+  static LogRecord *create(Type type, LoggerHandle *h, const uint8_t *data = nullptr, size_t size = 0, bool in_qlog = false);
+  static void destroy(LogRecord *r);
+  inline uint8_t *data() { return (uint8_t *)(this + 1); }
+
+  std::atomic<LogRecord *> next = nullptr;
+  Type type = Type::LOG;
+  bool in_qlog = false;
+  int epoch = -1;  // the segment of the handle when the record was created
+  LoggerHandle *h = nullptr;
+  size_t size = 0;
+  std::promise<void> *flushed = nullptr;
+};
+
+// Vyukov's intrusive multi-producer single-consumer queue, push never blocks or retries.
+class LogQueue {
+public:
+  LogQueue() : head(&stub), tail(&stub) {}
+  void push(LogRecord *r);
+  LogRecord *pop();  // nullptr if the queue is empty or a push is in progress
+
+private:
+  alignas(64) std::atomic<LogRecord *> head;
+  alignas(64) LogRecord *tail;
+  LogRecord stub;
+};
+
+// writers only take a reference on the handle and push records to the log thread of the LoggerState,
+// which owns the files. the epoch is the segment number, it changes when the slot is reused.
 typedef struct LoggerHandle {
-  pthread_mutex_t lock;
+  LoggerState *logger;
   SentinelType end_sentinel_type;
   int exit_signal;
-  int refcnt;
+  std::atomic<int> refcnt = 0;
+  std::atomic<int> epoch = -1;  // -1 once the files are closed
+  std::atomic<bool> in_use = false;
   char segment_path[4096];
   char log_path[4096];
   char qlog_path[4096];
   char lock_path[4096];
-  std::unique_ptr<RawFile> log, q_log;
+  std::unique_ptr<LogFile> log, q_log;  // only used by the log thread after opening
 } LoggerHandle;
 
 typedef struct LoggerState {
-  pthread_mutex_t lock;
+  ~LoggerState();
+
   int part;
   kj::Array<capnp::word> init_data;
   std::string route_name;
   char log_name[64];
   bool has_qlog;
+  bool compress;
 
   LoggerHandle handles[LOGGER_MAX_HANDLES];
-  LoggerHandle* cur_handle;
+  std::atomic<LoggerHandle*> cur_handle = nullptr;
+
+  LogQueue queue;
+  sem_t queued;  // posted once per record
+  std::atomic<size_t> queued_bytes = 0;  // the data of the records not written yet
+  std::atomic<int> space_waiters = 0;
+  std::mutex space_lock;
+  std::condition_variable space_cv;
+  std::thread log_thread;
 } LoggerState;
 
 kj::Array<capnp::word> logger_build_init_data();
 std::string logger_get_route_name();
-void logger_init(LoggerState *s, bool has_qlog);
+void logger_init(LoggerState *s, bool has_qlog, bool compress = false);
+// logger_next and logger_close must be called from the same thread, all other functions are thread safe.
 int logger_next(LoggerState *s, const char* root_path,
                             char* out_segment_path, size_t out_segment_path_len,
                             int* out_part);
 LoggerHandle* logger_get_handle(LoggerState *s);
 void logger_close(LoggerState *s, ExitHandler *exit_handler=nullptr);
+void logger_flush(LoggerState *s);  // waits until everything logged so far is written to the files
 void logger_log(LoggerState *s, uint8_t* data, size_t data_size, bool in_qlog);
 
 void lh_log(LoggerHandle* h, uint8_t* data, size_t data_size, bool in_qlog);
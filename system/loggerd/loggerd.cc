@@ -1,5 +1,6 @@
 #include "system/loggerd/loggerd.h"
 #include "system/loggerd/video_writer.h"
+#include "common/statlog.h"
 
 ExitHandler do_exit;
 
@@ -52,6 +53,7 @@ struct RemoteEncoder {
   int encoderd_segment_offset;
   int current_segment = -1;
   std::vector<Message *> q;
+  size_t q_high_water = 0;  // since the last stats
   int dropped_frames = 0;
   bool recording = false;
   bool marked_ready_to_rotate = false;
@@ -155,6 +157,7 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
     }
     // queue up all the new segment messages, they go in after the rotate
     re.q.push_back(msg);
+    re.q_high_water = std::max(re.q_high_water, re.q.size());
   } else {
     LOGE("%s: encoderd packet has a older segment!!! idx.getSegmentNum():%d s->rotate_segment:%d re.encoderd_segment_offset:%d",
       name.c_str(), idx.getSegmentNum(), s->rotate_segment.load(), re.encoderd_segment_offset);
@@ -167,14 +170,114 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
   return bytes_count;
 }
 
+void publish_write_stats() {
+  auto &stats = RawFile::stats;
+  statlog_gauge("loggerd_write_buffer_high_water_kb", int(stats.buffered_high_water.exchange(0) / 1024));
+  statlog_gauge("loggerd_write_stalls", int(stats.stalls.exchange(0)));
+  statlog_gauge("loggerd_log_queue_stalls", int(stats.queue_stalls.exchange(0)));
+  statlog_gauge("loggerd_video_queue_high_water", int(VideoWriter::stats.queue_high_water.exchange(0)));
+  statlog_gauge("loggerd_video_write_stalls", int(VideoWriter::stats.stalls.exchange(0)));
+
+  const auto latency = stats.write_latency.take();
+  std::string hist;
+  for (int i = 0; i < latency.size(); ++i) {
+    if (latency[i] > 0) hist += util::string_format(" <%luus:%lu", 1UL << i, latency[i]);
+  }
+  statlog_gauge("loggerd_write_latency_p50_us", (int)LatencyHistogram::percentile(latency, 0.5));
+  statlog_gauge("loggerd_write_latency_p99_us", (int)LatencyHistogram::percentile(latency, 0.99));
+  statlog_gauge("loggerd_write_latency_max_us", (int)LatencyHistogram::percentile(latency, 1.0));
+  LOGD("write latency histogram:%s", hist.c_str());
+}
+
+// 0 if the message can't be read
+static uint64_t log_mono_time(Message *msg) {
+  try {
+    capnp::FlatArrayMessageReader cmsg(kj::ArrayPtr<capnp::word>((capnp::word *)msg->getData(), msg->getSize() / sizeof(capnp::word)));
+    return cmsg.getRoot<cereal::Event>().getLogMonoTime();
+  } catch (const kj::Exception &) {
+    return 0;
+  }
+}
+
+struct ServiceState {
+  std::string name;
+  bool encoder;
+  QlogDecimator qlog;
+
+  // scheduling
+  size_t quantum, deficit = 0;
+  uint64_t latency_budget_ns;
+  bool over_budget = false;
+  Message *head = nullptr;  // received, waits for enough deficit
+  LatencyHistogram queue_delay;
+
+  // stats since the last publish
+  uint64_t period_ns;  // 0 if the service has no fixed frequency
+  uint64_t last_mono_time = 0;
+  uint64_t msgs = 0, bytes = 0, qlog_msgs = 0, drops = 0;
+  uint64_t qlog_changes = 0, qlog_over_budget = 0;  // the decimator counts at the last publish
+};
+
+// msgq has no sequence numbers, a drop is a gap of more than 1.5 periods between two messages of a service.
+// longer gaps than MAX_DROP_GAP periods are the publisher pausing.
+#define MAX_DROP_GAP 10
+
+static void update_service_stats(ServiceState &ss, size_t size, bool in_qlog, uint64_t mono_time) {
+  ss.msgs++;
+  ss.bytes += size;
+  ss.qlog_msgs += in_qlog;
+  if (ss.period_ns > 0 && ss.last_mono_time > 0 && mono_time > ss.last_mono_time) {
+    const uint64_t periods = (mono_time - ss.last_mono_time + ss.period_ns / 2) / ss.period_ns;
+    if (periods > 1 && periods <= MAX_DROP_GAP) ss.drops += periods - 1;
+  }
+  if (mono_time > 0) ss.last_mono_time = mono_time;
+}
+
+void publish_service_stats(std::unordered_map<SubSocket*, ServiceState> &service_states,
+                           std::unordered_map<SubSocket*, RemoteEncoder> &remote_encoders, double seconds) {
+  auto gauge = [](const char *metric, const std::string &name, auto value) {
+    statlog_gauge(util::string_format("%s.%s", metric, name.c_str()).c_str(), value);
+  };
+
+  std::string worst;
+  uint64_t worst_p99 = 0, msgs = 0, bytes = 0, drops = 0;
+  for (auto &[sock, ss] : service_states) {
+    const auto delay = ss.queue_delay.take();
+    if (ss.msgs == 0) continue;
+
+    const uint64_t p99 = LatencyHistogram::percentile(delay, 0.99);
+    gauge("loggerd_msgs_per_sec", ss.name, float(ss.msgs / seconds));
+    gauge("loggerd_kb_per_sec", ss.name, float(ss.bytes / 1024.0 / seconds));
+    gauge("loggerd_qlog_msgs", ss.name, (int)ss.qlog_msgs);
+    gauge("loggerd_qlog_changes", ss.name, int(ss.qlog.changes - ss.qlog_changes));
+    gauge("loggerd_qlog_over_budget", ss.name, int(ss.qlog.over_budget - ss.qlog_over_budget));
+    ss.qlog_changes = ss.qlog.changes;
+    ss.qlog_over_budget = ss.qlog.over_budget;
+    gauge("loggerd_drops", ss.name, (int)ss.drops);
+    gauge("loggerd_queue_delay_p99_us", ss.name, (int)p99);
+    gauge("loggerd_queue_delay_max_us", ss.name, (int)LatencyHistogram::percentile(delay, 1.0));
+    if (p99 > worst_p99) {
+      worst_p99 = p99;
+      worst = ss.name;
+    }
+    msgs += ss.msgs;
+    bytes += ss.bytes;
+    drops += ss.drops;
+    ss.msgs = ss.bytes = ss.qlog_msgs = ss.drops = 0;
+  }
+
+  for (auto &[sock, re] : remote_encoders) {
+    gauge("loggerd_encoder_queue", service_states[sock].name, (int)re.q_high_water);
+    re.q_high_water = re.q.size();
+  }
+
+  LOGD("%.2f msg/sec, %.2f KB/sec, %lu drops, highest queue delay p99 %luus on %s",
+       msgs / seconds, bytes / 1024.0 / seconds, drops, worst_p99, worst.c_str());
+}
+
 void loggerd_thread() {
   // setup messaging
-  typedef struct QlogState {
-    std::string name;
-    int counter, freq;
-    bool encoder;
-  } QlogState;
-  std::unordered_map<SubSocket*, QlogState> qlog_states;
+  std::unordered_map<SubSocket*, ServiceState> service_states;
   std::unordered_map<SubSocket*, struct RemoteEncoder> remote_encoders;
 
   std::unique_ptr<Context> ctx(Context::create());
@@ -189,17 +292,25 @@ void loggerd_thread() {
     SubSocket * sock = SubSocket::create(ctx.get(), it.name);
     assert(sock != NULL);
     poller->registerSocket(sock);
-    qlog_states[sock] = {
-      .name = it.name,
-      .counter = 0,
-      .freq = it.decimation,
-      .encoder = encoder,
-    };
+
+    auto schedule = service_schedules.find(it.name);
+    const ServiceSchedule sched = schedule != service_schedules.end() ? schedule->second : ServiceSchedule{};
+    ServiceState &ss = service_states[sock];
+    auto qlog_rule = qlog_rules.find(it.name);
+    QlogRule rule = qlog_rule != qlog_rules.end() ? qlog_rule->second : QlogRule{};
+    if (rule.decimation == 0) rule.decimation = it.decimation;
+
+    ss.name = it.name;
+    ss.encoder = encoder;
+    ss.qlog = QlogDecimator(rule);
+    ss.quantum = sched.weight * DRR_QUANTUM;
+    ss.latency_budget_ns = sched.latency_budget_ms * 1e6;
+    ss.period_ns = it.frequency > 0 ? 1e9 / it.frequency : 0;
   }
 
   LoggerdState s;
   // init logger
-  logger_init(&s.logger, true);
+  logger_init(&s.logger, true, Params().getBool("CompressLogs"));
   logger_rotate(&s);
   Params().put("CurrentRoute", s.logger.route_name);
 
@@ -211,42 +322,61 @@ void loggerd_thread() {
     }
   }
 
-  uint64_t msg_count = 0, bytes_count = 0;
-  double start_ts = millis_since_boot();
+  double last_stats_ts = millis_since_boot();
+  std::vector<SubSocket*> ready, backlog;
   while (!do_exit) {
-    // poll for new messages on all sockets
-    for (auto sock : poller->poll(1000)) {
+    // poll for new messages on all sockets, don't wait while services have a message waiting for their turn
+    ready = poller->poll(backlog.empty() ? 1000 : 0);
+    for (auto sock : backlog) {
+      if (std::find(ready.begin(), ready.end(), sock) == ready.end()) ready.push_back(sock);
+    }
+    backlog.clear();
+    std::stable_partition(ready.begin(), ready.end(), [&](SubSocket *sock) { return service_states[sock].over_budget; });
+
+    for (auto sock : ready) {
       if (do_exit) break;
 
-      // drain socket
-      int count = 0;
-      QlogState &qs = qlog_states[sock];
+      // log until the socket is empty or the service used its deficit
+      ServiceState &ss = service_states[sock];
+      ss.deficit += ss.quantum;
+      uint64_t max_delay = 0;
       Message *msg = nullptr;
-      while (!do_exit && (msg = sock->receive(true))) {
-        const bool in_qlog = qs.freq != -1 && (qs.counter++ % qs.freq == 0);
+      while (!do_exit && (msg = ss.head ? std::exchange(ss.head, nullptr) : sock->receive(true))) {
+        if (msg->getSize() > ss.deficit) {
+          ss.head = msg;
+          backlog.push_back(sock);
+          break;
+        }
+        ss.deficit -= msg->getSize();
+
+        const uint64_t mono_time = log_mono_time(msg), now = nanos_since_boot();
+        const uint64_t delay = mono_time > 0 && now > mono_time ? now - mono_time : 0;
+        ss.queue_delay.add(delay / 1000);
+        max_delay = std::max(max_delay, delay);
+
+        const bool in_qlog = !ss.encoder && ss.qlog.keep({(const capnp::word *)msg->getData(), msg->getSize() / sizeof(capnp::word)}, mono_time);
+        // the encoder index packets are always in the qlog
+        update_service_stats(ss, msg->getSize(), in_qlog || ss.encoder, mono_time);
 
-        if (qs.encoder) {
+        if (ss.encoder) {
           s.last_camera_seen_tms = millis_since_boot();
-          bytes_count += handle_encoder_msg(&s, msg, qs.name, remote_encoders[sock], encoder_infos_dict[qs.name]);
+          handle_encoder_msg(&s, msg, ss.name, remote_encoders[sock], encoder_infos_dict[ss.name]);
         } else {
           logger_log(&s.logger, (uint8_t *)msg->getData(), msg->getSize(), in_qlog);
-          bytes_count += msg->getSize();
           delete msg;
         }
 
         rotate_if_needed(&s);
-
-        if ((++msg_count % 1000) == 0) {
-          double seconds = (millis_since_boot() - start_ts) / 1000.0;
-          LOGD("%lu messages, %.2f msg/sec, %.2f KB/sec", msg_count, msg_count / seconds, bytes_count * 0.001 / seconds);
-        }
-
-        count++;
-        if (count >= 200) {
-          LOGD("large volume of '%s' messages", qs.name.c_str());
-          break;
-        }
       }
+      // an idle service doesn't keep its deficit
+      if (!ss.head) ss.deficit = 0;
+      ss.over_budget = max_delay > ss.latency_budget_ns;
+    }
+
+    if (double tms = millis_since_boot(); tms - last_stats_ts > STATS_INTERVAL_MS) {
+      publish_write_stats();
+      publish_service_stats(service_states, remote_encoders, (tms - last_stats_ts) / 1000.0);
+      last_stats_ts = tms;
     }
   }
 
@@ -260,7 +390,10 @@ void loggerd_thread() {
   }
 
   // messaging cleanup
-  for (auto &[sock, qs] : qlog_states) delete sock;
+  for (auto &[sock, ss] : service_states) {
+    delete ss.head;
+    delete sock;
+  }
 }
 
 int main(int argc, char** argv) {
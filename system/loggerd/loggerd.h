@@ -25,6 +25,7 @@
 
 #include "system/loggerd/encoder/encoder.h"
 #include "system/loggerd/logger.h"
+#include "system/loggerd/qlog_decimator.h"
 #ifdef QCOM2
 #include "system/loggerd/encoder/v4l_encoder.h"
 #define Encoder V4LEncoder
@@ -37,10 +38,53 @@ constexpr int MAIN_FPS = 20;
 const int MAIN_BITRATE = 10000000;
 
 #define NO_CAMERA_PATIENCE 500 // fall back to time-based rotation if all cameras are dead
+#define STATS_INTERVAL_MS 10000
+const size_t DRR_QUANTUM = 64 * 1024;  // bytes a service of weight 1 can log per round
+#define ENCODER_QUEUE_SIZE 3  // frames waiting for a software encoder
 
 const bool LOGGERD_TEST = getenv("LOGGERD_TEST");
 const int SEGMENT_LENGTH = LOGGERD_TEST ? atoi(getenv("LOGGERD_SEGMENT_LENGTH")) : 60;
 
+// loggerd_thread serves the ready services in deficit round robin, each round a service can log weight * DRR_QUANTUM
+// bytes. services over their latency budget go first in the next round. the defaults are weight 1 and 100ms.
+struct ServiceSchedule {
+  int weight = 1;
+  int latency_budget_ms = 100;
+};
+
+const std::unordered_map<std::string, ServiceSchedule> service_schedules = {
+  // the encoder packets are large and hold back the rotation
+  {"roadEncodeData", {.weight = 8, .latency_budget_ms = 50}},
+  {"wideRoadEncodeData", {.weight = 8, .latency_budget_ms = 50}},
+  {"driverEncodeData", {.weight = 8, .latency_budget_ms = 50}},
+  {"qRoadEncodeData", {.weight = 2, .latency_budget_ms = 50}},
+  // high rate services
+  {"can", {.weight = 4}},
+  {"sendcan", {.weight = 2}},
+  {"sensorEvents", {.weight = 2}},
+  // low rate services that change the state of the car
+  {"controlsState", {.latency_budget_ms = 20}},
+  {"carControl", {.latency_budget_ms = 20}},
+  {"pandaStates", {.latency_budget_ms = 20}},
+};
+
+// qlog selection of the services that differ from their decimation in services.h
+const std::unordered_map<std::string, QlogRule> qlog_rules = {
+  // even time coverage at the old rate, and every state change
+  {"controlsState", {.interval_ms = 100, .change_key = [](const cereal::Event::Reader &e) -> uint64_t {
+    auto cs = e.getControlsState();
+    return (uint64_t)cs.getState() << 1 | cs.getEnabled();
+  }}},
+  {"carState", {.interval_ms = 100, .change_key = [](const cereal::Event::Reader &e) -> uint64_t {
+    return (uint64_t)e.getCarState().getGearShifter();
+  }}},
+  {"deviceState", {.change_key = [](const cereal::Event::Reader &e) -> uint64_t {
+    return (uint64_t)e.getDeviceState().getThermalStatus();
+  }}},
+  // a burst of errors shouldn't crowd out the rest of the qlog
+  {"errorLogMessage", {.bytes_per_minute = 256 * 1024}},
+};
+
 class EncoderInfo {
 public:
   const char *publish_name;
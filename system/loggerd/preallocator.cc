@@ -0,0 +1,79 @@
+#include "system/loggerd/preallocator.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+
+#include "common/swaglog.h"
+#include "common/timing.h"
+
+FilePreallocator::FilePreallocator(int fd, const std::string &path)
+    : fd(fd), stream(path.substr(path.find_last_of('/') + 1)), start_ts(nanos_since_boot()) {
+  std::lock_guard lk(lock);
+  if (auto it = bitrates.find(stream); it != bitrates.end()) {
+    bitrate = it->second;
+  }
+}
+
+FilePreallocator::~FilePreallocator() {
+  if (allocated > size) {
+    // release the reserved blocks past the end of the file
+    if (ftruncate(fd, size) != 0) {
+      LOGW("failed to truncate %s: %d", stream.c_str(), errno);
+    }
+  }
+
+  // segments cut short say little about the bitrate
+  const double secs = (nanos_since_boot() - start_ts) / 1e9;
+  if (secs >= 1.0) {
+    std::lock_guard lk(lock);
+    auto [it, inserted] = bitrates.try_emplace(stream, size / secs);
+    if (!inserted) {
+      it->second = 0.5 * it->second + 0.5 * (size / secs);
+    }
+  }
+}
+
+void FilePreallocator::reserve(size_t end) {
+  if (!enabled || end <= allocated) return;
+
+#ifdef __linux__
+  double rate = bitrate;
+  if (rate == 0) {
+    // the first file of the stream, use its own rate once it is measurable
+    const double secs = (nanos_since_boot() - start_ts) / 1e9;
+    rate = secs >= 1.0 ? size / secs : 0;
+  }
+  const size_t step = std::clamp<size_t>(rate * PREALLOC_SECONDS, PREALLOC_MIN_SIZE, PREALLOC_MAX_SIZE);
+  const size_t offset = std::max(size, allocated);
+  const size_t len = std::max(end, offset + step) - offset;
+  // keep the size, so readers and a crash never see the reserved space
+  if (fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, len) == 0) {
+    allocated = offset + len;
+  } else {
+    LOGW("fallocate unsupported for %s: %d", stream.c_str(), errno);
+    allocated = SIZE_MAX;
+  }
+#endif
+}
+
+void FilePreallocator::written(size_t end) {
+  size = std::max(size, end);
+  if (!enabled || size - writeback_end < WRITEBACK_INTERVAL) return;
+
+#ifdef __linux__
+  // wait for the previous interval, then start the writeback of the new data without waiting
+  if (writeback_end > writeback_start) {
+    sync_file_range(fd, writeback_start, writeback_end - writeback_start,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+  }
+  sync_file_range(fd, writeback_end, size - writeback_end, SYNC_FILE_RANGE_WRITE);
+  writeback_start = writeback_end;
+  writeback_end = size;
+#else
+  fdatasync(fd);
+  writeback_start = writeback_end = size;
+#endif
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+const size_t PREALLOC_MIN_SIZE = 1024 * 1024;
+const size_t PREALLOC_MAX_SIZE = 64 * 1024 * 1024;
+const double PREALLOC_SECONDS = 10;  // reserve this much of the stream ahead of the writes
+const size_t WRITEBACK_INTERVAL = 4 * 1024 * 1024;  // start the writeback after this many new bytes
+
+// FilePreallocator keeps a file that is written front to back contiguous on disk and bounds its dirty pages.
+// the space ahead of the writes is reserved with fallocate, in steps of PREALLOC_SECONDS at the rolling bitrate
+// of the stream (the file name: rlog, fcamera.hevc, ...), and the space that was not used is released at close.
+// the written data is handed to the writeback every WRITEBACK_INTERVAL bytes, and the writer waits for the
+// interval before, so at most two intervals of the file are dirty instead of everything since the last flush.
+class FilePreallocator {
+public:
+  FilePreallocator(int fd, const std::string &path);
+  ~FilePreallocator();  // truncates the file to the written size and updates the bitrate of the stream
+  void reserve(size_t end);  // before writing up to end
+  void written(size_t end);  // after writing up to end
+
+  static inline bool enabled = true;  // for benchmarks
+
+private:
+  const int fd;
+  const std::string stream;
+  const uint64_t start_ts;
+  double bitrate = 0;  // bytes per second
+  size_t size = 0, allocated = 0;
+  size_t writeback_start = 0, writeback_end = 0;  // the last interval handed to the writeback
+
+  static inline std::mutex lock;
+  static inline std::unordered_map<std::string, double> bitrates;
+};
@@ -0,0 +1,47 @@
+#include "system/loggerd/qlog_decimator.h"
+
+bool QlogDecimator::keep(kj::ArrayPtr<const capnp::word> data, uint64_t mono_time) {
+  const size_t size = data.size() * sizeof(capnp::word);
+  if (const uint64_t m = mono_time / 60000000000ULL; m != minute) {
+    minute = m;
+    minute_bytes = 0;
+  }
+
+  if (rule.change_key) {
+    try {
+      capnp::FlatArrayMessageReader reader(data);
+      const uint64_t key = rule.change_key(reader.getRoot<cereal::Event>());
+      const bool changed = !has_key || key != last_key;
+      has_key = true;
+      last_key = key;
+      if (changed) {
+        changes++;
+        if (rule.interval_ms > 0) next_sample = mono_time + rule.interval_ms * 1000000ULL;
+        minute_bytes += size;
+        return true;
+      }
+    } catch (const kj::Exception &) {
+      // fall back to the sampling
+    }
+  }
+
+  const uint64_t interval = rule.interval_ms * 1000000ULL;
+  bool sampled = false;
+  if (rule.interval_ms > 0) {
+    sampled = mono_time >= next_sample;
+  } else if (rule.decimation > 0) {
+    sampled = counter++ % rule.decimation == 0;
+  }
+  if (!sampled) return false;
+
+  if (rule.bytes_per_minute > 0 && minute_bytes + size > rule.bytes_per_minute) {
+    over_budget++;
+    return false;
+  }
+  if (rule.interval_ms > 0) {
+    // advance on the grid so the jitter of the messages doesn't stretch the interval, restart it after a gap
+    next_sample = mono_time >= next_sample + interval ? mono_time + interval : next_sample + interval;
+  }
+  minute_bytes += size;
+  return true;
+}
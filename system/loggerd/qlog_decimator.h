@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <capnp/serialize.h>
+
+#include "cereal/gen/cpp/log.capnp.h"
+
+// a value of the message that keeps it in the qlog when it changes, e.g. a state or a flag
+typedef uint64_t (*QlogChangeKey)(const cereal::Event::Reader &event);
+
+struct QlogRule {
+  int decimation = 0;  // every nth message, -1 for none, 0 for the decimation of the service
+  int interval_ms = 0;  // at most one message per interval, instead of the decimation
+  size_t bytes_per_minute = 0;  // limits the sampled messages, 0 for unlimited
+  QlogChangeKey change_key = nullptr;  // changed messages are kept regardless of the sampling and the budget
+};
+
+// QlogDecimator selects the messages of a service that go to the qlog.
+// the message is only parsed for rules with a change key.
+class QlogDecimator {
+public:
+  QlogDecimator(const QlogRule &rule = {}) : rule(rule) {}
+  bool keep(kj::ArrayPtr<const capnp::word> data, uint64_t mono_time);
+
+  uint64_t changes = 0, over_budget = 0;  // kept for a change, dropped for the budget
+
+private:
+  QlogRule rule;
+  uint64_t counter = 0;
+  uint64_t next_sample = 0;  // the interval grid, the first message at or after it is kept
+  uint64_t last_key = 0;
+  bool has_key = false;
+  uint64_t minute = 0;
+  size_t minute_bytes = 0;
+};
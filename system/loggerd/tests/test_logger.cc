@@ -1,7 +1,13 @@
 #include <sys/stat.h>
 
+#include <bzlib.h>
+
+#include <algorithm>
 #include <climits>
 #include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <random>
 #include <sstream>
 #include <thread>
 #include <utility>
@@ -14,23 +20,27 @@
 
 typedef cereal::Sentinel::SentinelType SentinelType;
 
-void verify_segment(const std::string &route_path, int segment, int max_segment, int required_event_cnt) {
+void verify_segment(const std::string &route_path, int segment, int max_segment, int required_event_cnt, bool compressed = false) {
   const std::string segment_path = route_path + "--" + std::to_string(segment);
   SentinelType begin_sentinel = segment == 0 ? SentinelType::START_OF_ROUTE : SentinelType::START_OF_SEGMENT;
   SentinelType end_sentinel = segment == max_segment - 1 ? SentinelType::END_OF_ROUTE : SentinelType::END_OF_SEGMENT;
 
-  REQUIRE(!util::file_exists(segment_path + "/rlog.lock"));
+  REQUIRE(!util::file_exists(segment_path + (compressed ? "/rlog.bz2.lock" : "/rlog.lock")));
   for (const char *fn : {"/rlog", "/qlog"}) {
     const std::string log_file = segment_path + fn;
-    std::string log = util::read_file(log_file);
+    std::string log = compressed ? util::check_output("bzip2 -dc " + log_file + ".bz2") : util::read_file(log_file);
     REQUIRE(!log.empty());
     int event_cnt = 0, i = 0;
+    std::vector<LogIndexEntry> events;
     kj::ArrayPtr<const capnp::word> words((capnp::word *)log.data(), log.size() / sizeof(capnp::word));
     while (words.size() > 0) {
       try {
         capnp::FlatArrayMessageReader reader(words);
         auto event = reader.getRoot<cereal::Event>();
+        const size_t offset = (const char *)words.begin() - log.data();
         words = kj::arrayPtr(reader.getEnd(), words.end());
+        events.push_back({.offset = offset, .mono_time = event.getLogMonoTime(),
+                          .size = (uint32_t)((const char *)words.begin() - log.data() - offset), .which = event.which()});
         if (i == 0) {
           REQUIRE(event.which() == cereal::Event::INIT_DATA);
         } else if (i == 1) {
@@ -54,6 +64,34 @@ void verify_segment(const std::string &route_path, int segment, int max_segment,
       }
     }
     REQUIRE(event_cnt == required_event_cnt);
+
+    // the index has one entry per event and the end entry, and one per stream of a compressed log
+    std::string index = util::read_file(segment_path + fn + ".idx");
+    REQUIRE((index.size() - sizeof(LogIndexHeader)) % sizeof(LogIndexEntry) == 0);
+    auto header = (const LogIndexHeader *)index.data();
+    REQUIRE(memcmp(header->magic, LOG_INDEX_MAGIC, sizeof(header->magic)) == 0);
+    REQUIRE(header->version == LOG_INDEX_VERSION);
+    std::vector<LogIndexEntry> entries;
+    int stream_cnt = 0;
+    for (size_t pos = sizeof(LogIndexHeader); pos < index.size(); pos += sizeof(LogIndexEntry)) {
+      auto e = (const LogIndexEntry *)&index[pos];
+      if (e->which == LOG_INDEX_STREAM) {
+        ++stream_cnt;
+      } else {
+        entries.push_back(*e);
+      }
+    }
+    REQUIRE(entries.size() == events.size() + 1);
+    REQUIRE((stream_cnt > 0) == compressed);
+    for (int j = 0; j < events.size(); ++j) {
+      REQUIRE(entries[j].offset == events[j].offset);
+      REQUIRE(entries[j].size == events[j].size);
+      REQUIRE(entries[j].which == events[j].which);
+      REQUIRE(entries[j].mono_time == events[j].mono_time);
+    }
+    REQUIRE(entries[events.size()].which == LOG_INDEX_END);
+    REQUIRE(entries[events.size()].offset == log.size());
+    REQUIRE(entries[events.size()].mono_time == events.size());
   }
 }
 
@@ -138,10 +176,184 @@ TEST_CASE("logger") {
     do_exit = true;
     do_exit.signal = 1;
     logger_close(&logger, &do_exit);
-    REQUIRE(logger.cur_handle->refcnt == 0);
+    REQUIRE(logger.cur_handle.load()->refcnt == 0);
+    REQUIRE(logger.queued_bytes == 0);
 
     for (int i = 0; i < segment_cnt; ++i) {
       verify_segment(log_root + "/" + logger.route_name, i, segment_cnt, event_cnt[i]);
     }
   }
 }
+
+TEST_CASE("logger throughput", "[.benchmark]") {
+  const std::string log_root = "/tmp/test_logger";
+  system(("rm " + log_root + " -rf").c_str());
+
+  LoggerState logger = {};
+  logger_init(&logger, true);
+  REQUIRE(logger_next(&logger, log_root.c_str(), nullptr, 0, nullptr) == 0);
+
+  MessageBuilder msg;
+  msg.initEvent().initClocks();
+  auto bytes = msg.toBytes();
+  const int msg_cnt = 100000;
+  for (int thread_cnt : {1, 4, 8}) {
+    BENCHMARK(std::to_string(thread_cnt) + " threads, " + std::to_string(msg_cnt) + " messages") {
+      std::vector<std::thread> threads;
+      for (int i = 0; i < thread_cnt; ++i) {
+        threads.emplace_back([&]() {
+          LoggerHandle *lh = logger_get_handle(&logger);
+          for (int j = 0; j < msg_cnt / thread_cnt; ++j) {
+            lh_log(lh, bytes.begin(), bytes.size(), j % 10 == 0);
+          }
+          lh_close(lh);
+        });
+      }
+      for (auto &t : threads) t.join();
+      // include the writes of the log thread, not only the enqueue
+      logger_flush(&logger);
+    };
+  }
+  logger_close(&logger);
+}
+
+TEST_CASE("logger compression") {
+  const std::string log_root = "/tmp/test_logger";
+  system(("rm " + log_root + " -rf").c_str());
+
+  ExitHandler do_exit;
+  LoggerState logger = {};
+  logger_init(&logger, true, true);
+  const int segment_cnt = 10;
+  for (int i = 0; i < segment_cnt; ++i) {
+    REQUIRE(logger_next(&logger, log_root.c_str(), nullptr, 0, nullptr) == 0);
+    for (int j = 0; j < 1000; ++j) {
+      write_msg(logger.cur_handle);
+    }
+  }
+  do_exit = true;
+  do_exit.signal = 1;
+  logger_close(&logger, &do_exit);
+  for (int i = 0; i < segment_cnt; ++i) {
+    verify_segment(log_root + "/" + logger.route_name, i, segment_cnt, 1000, true);
+  }
+}
+
+TEST_CASE("LogFile index of a compressed log") {
+  const std::string fn = "/tmp/test_logfile.bz2", index_fn = "/tmp/test_logfile.idx";
+  std::vector<std::string> msgs;
+  {
+    LogFile f(fn.c_str(), index_fn.c_str(), true);
+    std::mt19937 rng(0);
+    for (int i = 0; i < 5000; ++i) {
+      msgs.push_back(util::random_string(rng() % 2000 + 8));
+      f.write((uint8_t *)msgs.back().data(), msgs.back().size(), i % 100, i);
+    }
+  }
+
+  std::string index = util::read_file(index_fn);
+  std::vector<LogIndexEntry> entries;
+  std::vector<LogIndexStream> streams;
+  for (size_t pos = sizeof(LogIndexHeader); pos < index.size(); pos += sizeof(LogIndexEntry)) {
+    auto e = (const LogIndexEntry *)&index[pos];
+    if (e->which == LOG_INDEX_STREAM) {
+      streams.push_back(*(const LogIndexStream *)e);
+    } else {
+      entries.push_back(*e);
+    }
+  }
+  REQUIRE(entries.size() == msgs.size() + 1);
+  const uint64_t log_size = entries.back().offset;
+
+  // the streams follow each other in the file and are cut by size
+  struct stat st = {};
+  REQUIRE(stat(fn.c_str(), &st) == 0);
+  REQUIRE(streams.size() > 1);
+  REQUIRE(streams.size() <= log_size / (RAWFILE_STREAM_SIZE - 2048) + 1);
+  REQUIRE(streams[0].offset == 0);
+  REQUIRE(streams[0].file_offset == 0);
+  for (int i = 1; i < streams.size(); ++i) {
+    REQUIRE(streams[i].offset > streams[i - 1].offset);
+    REQUIRE(streams[i].file_offset == streams[i - 1].file_offset + streams[i - 1].file_size);
+  }
+  REQUIRE(streams.back().file_offset + streams.back().file_size == st.st_size);
+
+  // read messages by decompressing only the stream that holds them
+  std::ifstream log(fn, std::ios::binary);
+  for (int i = 0; i < msgs.size(); i += 37) {
+    auto it = std::upper_bound(streams.begin(), streams.end(), entries[i].offset,
+                               [](uint64_t offset, const LogIndexStream &s) { return offset < s.offset; });
+    REQUIRE(it != streams.begin());
+    const LogIndexStream &s = *(it - 1);
+    const uint64_t stream_end = it == streams.end() ? log_size : it->offset;
+
+    std::string in(s.file_size, '\0'), out(stream_end - s.offset, '\0');
+    log.seekg(s.file_offset);
+    log.read(in.data(), in.size());
+    unsigned int out_size = out.size();
+    REQUIRE(BZ2_bzBuffToBuffDecompress(out.data(), &out_size, in.data(), in.size(), 0, 0) == BZ_OK);
+    REQUIRE(out_size == out.size());
+    REQUIRE(entries[i].offset + entries[i].size <= stream_end);
+    REQUIRE(out.substr(entries[i].offset - s.offset, entries[i].size) == msgs[i]);
+  }
+}
+
+TEST_CASE("RawFile") {
+  const std::string fn = "/tmp/test_rawfile";
+  std::string expected;
+  {
+    RawFile f(fn.c_str());
+    std::mt19937 rng(0);
+    for (int i = 0; i < 1000; ++i) {
+      // sizes around the buffer size exercise the split writes
+      std::string data = util::random_string(rng() % (RAWFILE_BUFFER_SIZE / 100) + (i % 100 == 0 ? RAWFILE_BUFFER_SIZE : 0));
+      f.write(data.data(), data.size());
+      expected += data;
+    }
+    // the partially filled buffer is written in time
+    usleep(RAWFILE_FLUSH_MS * 3 * 1000);
+    REQUIRE(util::read_file(fn) == expected);
+  }
+  REQUIRE(util::read_file(fn) == expected);
+  REQUIRE(RawFile::stats.buffered_high_water > 0);
+  // the preallocated space is released
+  struct stat st = {};
+  REQUIRE(stat(fn.c_str(), &st) == 0);
+  REQUIRE(st.st_blocks * 512 < expected.size() + 64 * 1024);
+}
+
+TEST_CASE("file preallocation", "[.benchmark]") {
+  // a synthetic load of three camera streams and two logs, written faster than real time
+  const std::string root = "/tmp/test_prealloc";
+  struct Stream { std::string name; size_t write_size, segment_size; };
+  const std::vector<Stream> streams = {
+    {"fcamera.hevc", 60 * 1024, 32 * 1024 * 1024}, {"ecamera.hevc", 60 * 1024, 32 * 1024 * 1024},
+    {"dcamera.hevc", 30 * 1024, 16 * 1024 * 1024}, {"rlog", 1024, 8 * 1024 * 1024}, {"qlog", 128, 512 * 1024}};
+  const int segment_cnt = 4;
+
+  for (bool enabled : {false, true}) {
+    system(("rm " + root + " -rf").c_str());
+    FilePreallocator::enabled = enabled;
+    RawFile::stats.write_latency.take();
+    for (int seg = 0; seg < segment_cnt; ++seg) {
+      const std::string dir = root + "/" + std::to_string(seg);
+      REQUIRE(util::create_directories(dir, 0775));
+      std::vector<std::thread> threads;
+      for (auto &stream : streams) {
+        threads.emplace_back([&]() {
+          RawFile f((dir + "/" + stream.name).c_str());
+          const std::string data = util::random_string(stream.write_size);
+          for (size_t written = 0; written < stream.segment_size; written += data.size()) {
+            f.write((void *)data.data(), data.size());
+          }
+        });
+      }
+      for (auto &t : threads) t.join();
+    }
+    auto counts = RawFile::stats.write_latency.take();
+    printf("preallocation %s: write latency p50 %llu us, p99 %llu us, p99.9 %llu us, max %llu us\n", enabled ? "on" : "off",
+           (unsigned long long)LatencyHistogram::percentile(counts, 0.5), (unsigned long long)LatencyHistogram::percentile(counts, 0.99),
+           (unsigned long long)LatencyHistogram::percentile(counts, 0.999), (unsigned long long)LatencyHistogram::percentile(counts, 1.0));
+  }
+  FilePreallocator::enabled = true;
+}
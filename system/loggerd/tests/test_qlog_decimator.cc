@@ -0,0 +1,88 @@
+#include <random>
+
+#include "catch2/catch.hpp"
+#include "cereal/messaging/messaging.h"
+#include "system/loggerd/qlog_decimator.h"
+
+typedef cereal::DeviceState::ThermalStatus ThermalStatus;
+
+static kj::Array<capnp::word> device_state(uint64_t mono_time, ThermalStatus status = ThermalStatus::GREEN) {
+  MessageBuilder msg;
+  auto event = msg.initEvent();
+  event.setLogMonoTime(mono_time);
+  event.initDeviceState().setThermalStatus(status);
+  return capnp::messageToFlatArray(msg);
+}
+
+static uint64_t thermal_status(const cereal::Event::Reader &event) {
+  return (uint64_t)event.getDeviceState().getThermalStatus();
+}
+
+static int kept(QlogDecimator &d, int msg_cnt, uint64_t step_ms) {
+  int cnt = 0;
+  for (int i = 0; i < msg_cnt; ++i) {
+    auto words = device_state(1e9 + i * step_ms * 1e6);
+    cnt += d.keep(words.asPtr(), 1e9 + i * step_ms * 1e6);
+  }
+  return cnt;
+}
+
+TEST_CASE("QlogDecimator") {
+  SECTION("decimation") {
+    QlogDecimator d({.decimation = 10});
+    REQUIRE(kept(d, 100, 10) == 10);
+    QlogDecimator none({.decimation = -1});
+    REQUIRE(kept(none, 100, 10) == 0);
+  }
+  SECTION("interval") {
+    // a burst doesn't change the coverage
+    QlogDecimator d({.interval_ms = 100});
+    REQUIRE(kept(d, 100, 10) == 10);
+    QlogDecimator burst({.interval_ms = 100});
+    REQUIRE(kept(burst, 1000, 1) == 10);
+  }
+  SECTION("interval with jitter") {
+    // 100Hz with +-3ms of jitter over 10s still keeps one message per 100ms
+    QlogDecimator d({.interval_ms = 100});
+    std::mt19937 rng(0);
+    int cnt = 0;
+    for (int i = 0; i < 1000; ++i) {
+      const uint64_t mono_time = 1e9 + i * 10e6 + (int(rng() % 7) - 3) * 1e6;
+      auto words = device_state(mono_time);
+      cnt += d.keep(words.asPtr(), mono_time);
+    }
+    REQUIRE(cnt == 100);
+  }
+  SECTION("change") {
+    QlogDecimator d({.decimation = -1, .change_key = thermal_status});
+    const ThermalStatus statuses[] = {ThermalStatus::GREEN, ThermalStatus::GREEN, ThermalStatus::YELLOW, ThermalStatus::YELLOW, ThermalStatus::RED};
+    std::vector<bool> result;
+    uint64_t mono_time = 1e9;
+    for (auto status : statuses) {
+      auto words = device_state(mono_time += 1e6, status);
+      result.push_back(d.keep(words.asPtr(), mono_time));
+    }
+    REQUIRE(result == std::vector<bool>{true, false, true, false, true});
+    REQUIRE(d.changes == 3);
+  }
+  SECTION("budget") {
+    const size_t size = device_state(0).size() * sizeof(capnp::word);
+    QlogDecimator d({.decimation = 1, .bytes_per_minute = size * 5});
+    REQUIRE(kept(d, 100, 10) == 5);
+    REQUIRE(d.over_budget == 95);
+    // a new minute
+    auto words = device_state(61e9);
+    REQUIRE(d.keep(words.asPtr(), 61e9));
+  }
+}
+
+TEST_CASE("QlogDecimator benchmark", "[.benchmark]") {
+  auto words = device_state(1e9);
+  QlogDecimator decimation({.decimation = 10});
+  QlogDecimator interval({.interval_ms = 100});
+  QlogDecimator change({.decimation = 10, .change_key = thermal_status});
+  uint64_t mono_time = 1e9;
+  BENCHMARK("decimation") { return decimation.keep(words.asPtr(), mono_time += 1e6); };
+  BENCHMARK("interval") { return interval.keep(words.asPtr(), mono_time += 1e6); };
+  BENCHMARK("change") { return change.keep(words.asPtr(), mono_time += 1e6); };
+}
@@ -7,7 +7,7 @@ import logging
 import json
 
 from system.swaglog import cloudlog
-from system.loggerd.uploader import uploader_fn, UPLOAD_ATTR_NAME, UPLOAD_ATTR_VALUE
+from system.loggerd.uploader import Uploader, uploader_fn, setxattr, UPLOAD_ATTR_NAME, UPLOAD_ATTR_VALUE
 
 from system.loggerd.tests.loggerd_tests_common import UploaderTestCase
 
@@ -86,6 +86,24 @@ class TestUploader(UploaderTestCase):
 
     self.assertTrue(log_handler.upload_order == exp_order, "Files uploaded in wrong order")
 
+  def test_upload_compressed_segment(self):
+    for t in ["rlog.bz2", "rlog.idx", "fcamera.hevc", "qlog.bz2", "qlog.idx"]:
+      self.make_file_with_data(self.seg_dir, t, 1)
+
+    def upload_order(with_raw):
+      u = Uploader("0000000000000000", self.root)
+      order = []
+      while (d := u.next_file_to_upload(with_raw)) is not None:
+        key, fn = d
+        order.append(key)
+        setxattr(fn, UPLOAD_ATTR_NAME, UPLOAD_ATTR_VALUE)
+      return order
+
+    # qlog stays in the immediate tier, the indexes, full log and video need raw uploads enabled
+    self.assertEqual(upload_order(False), [f"{self.seg_dir}/qlog.bz2"])
+    self.assertEqual(upload_order(True), [f"{self.seg_dir}/rlog.bz2", f"{self.seg_dir}/rlog.idx", f"{self.seg_dir}/qlog.idx",
+                                          f"{self.seg_dir}/fcamera.hevc"])
+
   def test_upload_with_wrong_xattr(self):
     self.gen_files(lock=False, xattr=b'0')
 
@@ -73,8 +73,10 @@ class Uploader():
     self.last_filename = ""
 
     self.immediate_folders = ["crash/", "boot/"]
-    self.immediate_priority = {"qlog": 0, "qcamera.ts": 1}
-    self.high_priority = {"rlog": 0}
+    # with CompressLogs set loggerd writes {q,r}log.bz2 directly. the .idx sidecars are uncompressed
+    # (24 bytes per message) and can be rebuilt from the log, so they only go with the raw uploads
+    self.immediate_priority = {"qlog": 0, "qlog.bz2": 0, "qcamera.ts": 2}
+    self.high_priority = {"rlog": 0, "rlog.bz2": 0, "rlog.idx": 1, "qlog.idx": 2}
     self.normal_priority = {"fcamera.hevc": 1, "dcamera.hevc": 2, "ecamera.hevc": 3}
 
   def get_upload_sort(self, name):
@@ -2,6 +2,8 @@
 #include <cassert>
 #include <cstdlib>
 
+#include <algorithm>
+
 #include "system/loggerd/video_writer.h"
 #include "common/swaglog.h"
 #include "common/util.h"
@@ -17,6 +19,10 @@ VideoWriter::VideoWriter(const char *path, const char *filename, bool remuxing,
   close(lock_fd);
 
   LOGD("encoder_open %s remuxing:%d", this->vid_path.c_str(), this->remuxing);
+  fd = HANDLE_EINTR(open(vid_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0664));
+  assert(fd >= 0);
+  prealloc = std::make_unique<FilePreallocator>(fd, vid_path);
+
   if (this->remuxing) {
     avformat_alloc_output_context2(&this->ofmt_ctx, NULL, raw ? "matroska" : NULL, this->vid_path.c_str());
     assert(this->ofmt_ctx);
@@ -42,73 +48,175 @@ VideoWriter::VideoWriter(const char *path, const char *filename, bool remuxing,
     this->out_stream = avformat_new_stream(this->ofmt_ctx, raw ? avcodec : NULL);
     assert(this->out_stream);
 
-    int err = avio_open(&this->ofmt_ctx->pb, this->vid_path.c_str(), AVIO_FLAG_WRITE);
-    assert(err >= 0);
+    const int buffer_size = 64 * 1024;
+    uint8_t *buffer = (uint8_t *)av_malloc(buffer_size);
+    assert(buffer);
+    this->ofmt_ctx->pb = avio_alloc_context(buffer, buffer_size, 1, this, NULL, writePacket, seekPacket);
+    assert(this->ofmt_ctx->pb);
+  }
+  muxer_thread = std::thread(&VideoWriter::muxerThread, this);
+}
 
-  } else {
-    this->of = util::safe_fopen(this->vid_path.c_str(), "wb");
-    assert(this->of);
+bool VideoWriter::writeFile(const uint8_t *data, size_t len) {
+  prealloc->reserve(file_pos + len);
+  size_t written = 0;
+  while (written < len) {
+    ssize_t ret = HANDLE_EINTR(pwrite(fd, data + written, len - written, file_pos + written));
+    if (ret <= 0) {
+      LOGE("failed to write file.errno=%d", errno);
+      return false;
+    }
+    written += ret;
   }
+  file_pos += len;
+  file_size = std::max(file_size, file_pos);
+  prealloc->written(file_pos);
+  return true;
+}
+
+int VideoWriter::writePacket(void *opaque, uint8_t *buf, int size) {
+  return ((VideoWriter *)opaque)->writeFile(buf, size) ? size : AVERROR(EIO);
+}
+
+int64_t VideoWriter::seekPacket(void *opaque, int64_t offset, int whence) {
+  VideoWriter *w = (VideoWriter *)opaque;
+  if (whence == AVSEEK_SIZE) return w->file_size;
+
+  whence &= ~AVSEEK_FORCE;
+  if (whence == SEEK_CUR) {
+    offset += w->file_pos;
+  } else if (whence == SEEK_END) {
+    offset += w->file_size;
+  } else if (whence != SEEK_SET) {
+    return AVERROR(EINVAL);
+  }
+  if (offset < 0) return AVERROR(EINVAL);
+  w->file_pos = offset;
+  return offset;
 }
 
 void VideoWriter::write(uint8_t *data, int len, long long timestamp, bool codecconfig, bool keyframe) {
-  if (of && data) {
-    size_t written = util::safe_fwrite(data, 1, len, of);
-    if (written != len) {
-      LOGE("failed to write file.errno=%d", errno);
+  std::unique_lock lk(lock);
+  if (queued_bytes > 0 && queued_bytes + len > VIDEO_WRITER_MAX_QUEUED) {
+    stats.stalls++;
+    space_cv.wait(lk, [&]() { return queued_bytes == 0 || queued_bytes + len <= VIDEO_WRITER_MAX_QUEUED; });
+  }
+
+  queue.push_back({.data = data ? std::vector<uint8_t>(data, data + len) : std::vector<uint8_t>(),
+                   .timestamp = timestamp, .codecconfig = codecconfig, .keyframe = keyframe});
+  queued_bytes += queue.back().data.size();
+  keyframe_queued |= keyframe;
+  if (keyframe || queued_bytes >= VIDEO_WRITER_BATCH_SIZE) {
+    mux_cv.notify_one();
+  }
+
+  size_t high_water = stats.queue_high_water;
+  while (queue.size() > high_water && !stats.queue_high_water.compare_exchange_weak(high_water, queue.size())) {}
+}
+
+void VideoWriter::muxerThread() {
+  util::set_thread_name("loggerd_mux");
+  std::deque<Packet> batch;
+  std::unique_lock lk(lock);
+  while (true) {
+    mux_cv.wait_for(lk, std::chrono::milliseconds(VIDEO_WRITER_FLUSH_MS), [&]() {
+      return exit || keyframe_queued || queued_bytes >= VIDEO_WRITER_BATCH_SIZE;
+    });
+    if (queue.empty()) {
+      if (exit) break;
+      continue;
     }
+
+    batch.swap(queue);
+    const size_t batch_bytes = queued_bytes;
+    keyframe_queued = false;
+    lk.unlock();
+    writeBatch(batch);
+    batch.clear();
+    lk.lock();
+
+    queued_bytes -= batch_bytes;
+    space_cv.notify_all();
   }
+}
 
-  if (remuxing) {
-    if (codecconfig) {
-      if (len > 0) {
-        codec_ctx->extradata = (uint8_t*)av_mallocz(len + AV_INPUT_BUFFER_PADDING_SIZE);
-        codec_ctx->extradata_size = len;
-        memcpy(codec_ctx->extradata, data, len);
-      }
-      int err = avcodec_parameters_from_context(out_stream->codecpar, codec_ctx);
-      assert(err >= 0);
-      err = avformat_write_header(ofmt_ctx, NULL);
-      assert(err >= 0);
-    } else {
-      // input timestamps are in microseconds
-      AVRational in_timebase = {1, 1000000};
+void VideoWriter::writeBatch(std::deque<Packet> &batch) {
+  if (!remuxing) {
+    // one write for the batch
+    raw_batch.clear();
+    for (auto &packet : batch) {
+      raw_batch.insert(raw_batch.end(), packet.data.begin(), packet.data.end());
+    }
+    writeFile(raw_batch.data(), raw_batch.size());
+    return;
+  }
 
-      AVPacket pkt;
-      av_init_packet(&pkt);
-      pkt.data = data;
-      pkt.size = len;
+  for (auto &packet : batch) {
+    mux(packet);
+  }
+  // the avio buffer is written at least once per batch
+  avio_flush(ofmt_ctx->pb);
+}
 
-      enum AVRounding rnd = static_cast<enum AVRounding>(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX);
-      pkt.pts = pkt.dts = av_rescale_q_rnd(timestamp, in_timebase, ofmt_ctx->streams[0]->time_base, rnd);
-      pkt.duration = av_rescale_q(50*1000, in_timebase, ofmt_ctx->streams[0]->time_base);
+void VideoWriter::mux(Packet &packet) {
+  uint8_t *data = packet.data.data();
+  const int len = packet.data.size();
+  if (packet.codecconfig) {
+    if (len > 0) {
+      codec_ctx->extradata = (uint8_t*)av_mallocz(len + AV_INPUT_BUFFER_PADDING_SIZE);
+      codec_ctx->extradata_size = len;
+      memcpy(codec_ctx->extradata, data, len);
+    }
+    int err = avcodec_parameters_from_context(out_stream->codecpar, codec_ctx);
+    assert(err >= 0);
+    err = avformat_write_header(ofmt_ctx, NULL);
+    assert(err >= 0);
+  } else {
+    // input timestamps are in microseconds
+    AVRational in_timebase = {1, 1000000};
 
-      if (keyframe) {
-        pkt.flags |= AV_PKT_FLAG_KEY;
-      }
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    pkt.data = data;
+    pkt.size = len;
 
-      // TODO: can use av_write_frame for non raw?
-      int err = av_interleaved_write_frame(ofmt_ctx, &pkt);
-      if (err < 0) { LOGW("ts encoder write issue len: %d ts: %lu", len, timestamp); }
+    enum AVRounding rnd = static_cast<enum AVRounding>(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX);
+    pkt.pts = pkt.dts = av_rescale_q_rnd(packet.timestamp, in_timebase, ofmt_ctx->streams[0]->time_base, rnd);
+    pkt.duration = av_rescale_q(50*1000, in_timebase, ofmt_ctx->streams[0]->time_base);
 
-      av_packet_unref(&pkt);
+    if (packet.keyframe) {
+      pkt.flags |= AV_PKT_FLAG_KEY;
     }
+
+    // TODO: can use av_write_frame for non raw?
+    int err = av_interleaved_write_frame(ofmt_ctx, &pkt);
+    if (err < 0) { LOGW("ts encoder write issue len: %d ts: %lld", len, packet.timestamp); }
+
+    av_packet_unref(&pkt);
   }
 }
 
 VideoWriter::~VideoWriter() {
+  // write all queued packets
+  {
+    std::lock_guard lk(lock);
+    exit = true;
+  }
+  mux_cv.notify_one();
+  muxer_thread.join();
+
   if (this->remuxing) {
     if (this->raw) { avcodec_close(this->codec_ctx); }
     int err = av_write_trailer(this->ofmt_ctx);
     if (err != 0) LOGE("av_write_trailer failed %d", err);
     avcodec_free_context(&this->codec_ctx);
-    err = avio_closep(&this->ofmt_ctx->pb);
-    if (err != 0) LOGE("avio_closep failed %d", err);
+    avio_flush(this->ofmt_ctx->pb);
+    if (this->ofmt_ctx->pb->error < 0) LOGE("avio_flush failed %d", this->ofmt_ctx->pb->error);
+    av_freep(&this->ofmt_ctx->pb->buffer);
+    avio_context_free(&this->ofmt_ctx->pb);
     avformat_free_context(this->ofmt_ctx);
-  } else {
-    util::safe_fflush(this->of);
-    fclose(this->of);
-    this->of = nullptr;
   }
+  prealloc.reset();
+  close(fd);
   unlink(this->lock_path.c_str());
 }
@@ -1,6 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -8,19 +15,61 @@ extern "C" {
 }
 
 #include "cereal/messaging/messaging.h"
+#include "system/loggerd/preallocator.h"
 
+const size_t VIDEO_WRITER_MAX_QUEUED = 32 * 1024 * 1024;  // the encoder waits when the storage falls this far behind
+const size_t VIDEO_WRITER_BATCH_SIZE = 1024 * 1024;
+const int VIDEO_WRITER_FLUSH_MS = 100;
+
+struct VideoWriterStats {
+  std::atomic<size_t> queue_high_water = 0;  // packets
+  std::atomic<uint64_t> stalls = 0;  // writes that waited for the muxer thread
+};
+
+// VideoWriter copies the packets into a queue and muxes and writes them from its own thread, so the
+// encoder only waits for the storage when the queue is full. the queue is written in batches: at every
+// keyframe, when it holds VIDEO_WRITER_BATCH_SIZE bytes, or after VIDEO_WRITER_FLUSH_MS. closing the
+// writer writes all queued packets, up to the last one of the segment, before the trailer.
 class VideoWriter {
 public:
   VideoWriter(const char *path, const char *filename, bool remuxing, int width, int height, int fps, cereal::EncodeIndex::Type codec);
   void write(uint8_t *data, int len, long long timestamp, bool codecconfig, bool keyframe);
   ~VideoWriter();
+
+  static inline VideoWriterStats stats;  // shared by all writers, published by loggerd
+
 private:
+  struct Packet {
+    std::vector<uint8_t> data;
+    long long timestamp;
+    bool codecconfig, keyframe;
+  };
+
+  void muxerThread();
+  void writeBatch(std::deque<Packet> &batch);
+  void mux(Packet &packet);
+  bool writeFile(const uint8_t *data, size_t len);
+  static int writePacket(void *opaque, uint8_t *buf, int size);
+  static int64_t seekPacket(void *opaque, int64_t offset, int whence);
+
   std::string vid_path, lock_path;
 
-  FILE *of = nullptr;
+  // both the raw stream and the muxer write through the fd, the muxer seeks to update headers
+  int fd = -1;
+  size_t file_pos = 0, file_size = 0;
+  std::unique_ptr<FilePreallocator> prealloc;
 
   AVCodecContext *codec_ctx;
   AVFormatContext *ofmt_ctx;
   AVStream *out_stream;
   bool remuxing, raw;
+
+  std::mutex lock;
+  std::condition_variable mux_cv, space_cv;
+  std::deque<Packet> queue;
+  size_t queued_bytes = 0;
+  bool keyframe_queued = false;
+  bool exit = false;
+  std::vector<uint8_t> raw_batch;  // only used by the muxer thread
+  std::thread muxer_thread;
 };
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include <QScrollBar>
 #include <QShortcut>
 #include <QToolTip>
+#include <QtConcurrent>
 
 #include "tools/cabana/commands.h"
 #include "tools/cabana/signalview.h"
@@ -17,6 +18,7 @@
 
 const int CELL_HEIGHT = 36;
 const int VERTICAL_HEADER_WIDTH = 30;
+const uint64_t ACTIVITY_WINDOW_NS = 10 * 1e9;
 
 inline int get_bit_index(const QModelIndex &index, bool little_endian) {
   return index.row() * 8 + (little_endian ? 7 - index.column() : index.column());
@@ -24,6 +26,7 @@ inline int get_bit_index(const QModelIndex &index, bool little_endian) {
 
 BinaryView::BinaryView(QWidget *parent) : QTableView(parent) {
   model = new BinaryViewModel(this);
+  model->activity = &activity;
   setModel(model);
   delegate = new BinaryItemDelegate(this);
   setItemDelegate(delegate);
@@ -38,6 +41,12 @@ BinaryView::BinaryView(QWidget *parent) : QTableView(parent) {
 
   QObject::connect(dbc(), &DBCManager::DBCFileChanged, this, &BinaryView::refresh);
   QObject::connect(UndoStack::instance(), &QUndoStack::indexChanged, this, &BinaryView::refresh);
+  QObject::connect(can, &AbstractStream::eventsMerged, this, [this]() {
+    activity.update();
+    model->updateState();
+  });
+  // the view is created when a message is first opened, count the events merged before.
+  activity.update();
 
   addShortcuts();
   setWhatsThis(R"(
@@ -208,6 +217,11 @@ void BinaryView::setMessage(const MessageId &message_id) {
   refresh();
 }
 
+void BinaryView::setTimeRange(double min, double max, bool is_zoomed) {
+  model->time_range = is_zoomed ? std::optional(std::make_pair(min, max)) : std::nullopt;
+  model->updateState();
+}
+
 void BinaryView::refresh() {
   clearSelection();
   anchor_index = QModelIndex();
@@ -312,6 +326,16 @@ void BinaryViewModel::updateState() {
     endInsertRows();
   }
 
+  // route-wide activity, fall back to the counts of the played events.
+  BitActivity::FlipCounts flips;
+  size_t count = time_range ? activity->flipCounts(msg_id, time_range->first, time_range->second, flips)
+                            : activity->flipCounts(msg_id, flips);
+  if (count == 0 && !time_range) {
+    flips.assign(last_msg.bit_change_counts.begin(), last_msg.bit_change_counts.end());
+    count = last_msg.count;
+  }
+
+  const auto colors = last_msg.colors(can->getSpeed());
   const double max_f = 255.0;
   const double factor = 0.25;
   const double scaler = max_f / log2(1.0 + factor);
@@ -321,15 +345,154 @@ void BinaryViewModel::updateState() {
       QString val = ((binary[i] >> (7 - j)) & 1) != 0 ? "1" : "0";
       // Bit update frequency based highlighting
       double offset = !item.sigs.empty() ? 50 : 0;
-      auto n = last_msg.bit_change_counts[i][7 - j];
+      uint32_t n = i < flips.size() ? flips[i][7 - j] : 0;
       double min_f = n == 0 ? offset : offset + 25;
-      double alpha = std::clamp(offset + log2(1.0 + factor * (double)n / (double)last_msg.count) * scaler, min_f, max_f);
+      double alpha = std::clamp(offset + log2(1.0 + factor * (double)n / (double)std::max<size_t>(count, 1)) * scaler, min_f, max_f);
       auto color = item.bg_color;
       color.setAlpha(alpha);
       updateItem(i, j, val, color);
     }
-    updateItem(i, 8, toHex(binary[i]), last_msg.colors[i]);
+    updateItem(i, 8, toHex(binary[i]), colors[i]);
+  }
+}
+
+// BitActivity
+
+void BitActivity::update() {
+  const auto &events_map = can->eventsMap();
+  const uint64_t first_ts = can->firstEventMonoTime();
+  if (first_ts == 0) return;
+
+  if (origin == 0 || first_ts < origin) {
+    // windows are relative to the first event, start over if earlier events are merged.
+    activities.clear();
+    origin = first_ts;
+  }
+
+  std::vector<std::pair<const CanEventList *, Activity *>> messages;
+  for (const auto &[id, events] : events_map) {
+    if (!events.empty()) {
+      messages.push_back({&events, &activities[id]});
+    }
+  }
+  const uint64_t o = origin;
+  QtConcurrent::blockingMap(messages, [o](auto &m) { updateActivity(*m.second, *m.first, o); });
+}
+
+void BitActivity::updateActivity(Activity &a, const CanEventList &events, uint64_t origin) {
+  if (a.events > 0) {
+    auto lo = std::lower_bound(events.cbegin(), events.cend(), a.first_mono_time, [](auto e, uint64_t ts) { return e->mono_time < ts; });
+    auto hi = std::upper_bound(lo, events.cend(), a.last_mono_time, [](uint64_t ts, auto e) { return ts < e->mono_time; });
+    const size_t counted = hi - lo;
+    if (counted == a.events) {
+      // new events were only merged before and after the counted ones.
+      if (lo != events.cbegin()) {
+        countFlips(a, origin, nullptr, events.cbegin(), lo);
+        addFlips(a, ((*lo)->mono_time - origin) / ACTIVITY_WINDOW_NS, *(lo - 1), *lo);
+      }
+      countFlips(a, origin, hi != events.cbegin() ? *(hi - 1) : nullptr, hi, events.cend());
+    } else if (counted < a.events && lo == events.cbegin()) {
+      // the oldest events were dropped. remove their windows and count the window of the first event again,
+      // it may have lost some of its events and the flip from the dropped event before it.
+      const size_t w = (events.front()->mono_time - origin) / ACTIVITY_WINDOW_NS;
+      dropWindows(a, w);
+      auto w_end = std::lower_bound(events.cbegin(), events.cend(), origin + (w + 1) * ACTIVITY_WINDOW_NS, [](auto e, uint64_t ts) {
+        return e->mono_time < ts;
+      });
+      countFlips(a, origin, nullptr, events.cbegin(), w_end);
+      auto first = std::max(hi, w_end);
+      countFlips(a, origin, first != events.cbegin() ? *(first - 1) : nullptr, first, events.cend());
+    } else {
+      // events were inserted in the middle, count the message again.
+      a = {};
+      countFlips(a, origin, nullptr, events.cbegin(), events.cend());
+    }
+  } else {
+    countFlips(a, origin, nullptr, events.cbegin(), events.cend());
+  }
+  a.first_mono_time = events.front()->mono_time;
+  a.last_mono_time = events.back()->mono_time;
+  a.events = events.size();
+}
+
+void BitActivity::countFlips(Activity &a, uint64_t origin, const CanEvent *prev, CanEventList::const_iterator first, CanEventList::const_iterator last) {
+  for (auto it = first; it != last; ++it) {
+    const size_t w = ((*it)->mono_time - origin) / ACTIVITY_WINDOW_NS;
+    if (w >= a.window_events.size()) {
+      a.window_events.resize(w + 1, 0);
+      a.window_flips.resize(w + 1);
+    }
+    ++a.window_events[w];
+    if (prev) {
+      addFlips(a, w, prev, *it);
+    }
+    prev = *it;
+  }
+}
+
+void BitActivity::addFlips(Activity &a, size_t window, const CanEvent *prev, const CanEvent *e) {
+  const int size = std::min(prev->size, e->size);
+  auto &window_flips = a.window_flips[window];
+  if (a.flips.size() < size) a.flips.resize(size, {});
+  if (window_flips.size() < size) window_flips.resize(size, {});
+
+  // xor 8 bytes at a time, then walk the flipped bits.
+  for (int i = 0; i < size; i += 8) {
+    uint64_t x = 0, y = 0;
+    const int n = std::min(8, size - i);
+    memcpy(&x, prev->dat + i, n);
+    memcpy(&y, e->dat + i, n);
+    for (uint64_t diff = x ^ y; diff != 0; diff &= diff - 1) {
+      const int bit = __builtin_ctzll(diff);
+      ++a.flips[i + bit / 8][bit % 8];
+      ++window_flips[i + bit / 8][bit % 8];
+    }
+  }
+}
+
+// subtracts the windows up to and including last from the totals and clears them.
+void BitActivity::dropWindows(Activity &a, size_t last) {
+  for (size_t w = a.first_window; w <= last && w < a.window_events.size(); ++w) {
+    const auto &window_flips = a.window_flips[w];
+    for (int i = 0; i < window_flips.size(); ++i) {
+      for (int j = 0; j < 8; ++j) {
+        a.flips[i][j] -= window_flips[i][j];
+      }
+    }
+    a.window_events[w] = 0;
+    a.window_flips[w] = {};
+  }
+  a.first_window = std::max(a.first_window, last);
+}
+
+size_t BitActivity::flipCounts(const MessageId &id, FlipCounts &counts) const {
+  auto it = activities.find(id);
+  if (it == activities.end()) return 0;
+
+  counts = it->second.flips;
+  return it->second.events;
+}
+
+size_t BitActivity::flipCounts(const MessageId &id, double min_sec, double max_sec, FlipCounts &counts) const {
+  auto it = activities.find(id);
+  if (it == activities.end() || it->second.window_events.empty()) return 0;
+
+  const auto &a = it->second;
+  const double route_start = can->routeStartTime() * 1e9;
+  auto window = [&](double sec) -> size_t {
+    return std::clamp<double>((sec * 1e9 + route_start - origin) / ACTIVITY_WINDOW_NS, 0, a.window_events.size() - 1);
+  };
+  size_t events = 0;
+  counts.assign(a.flips.size(), {});
+  for (size_t w = window(min_sec), last = window(max_sec); w <= last; ++w) {
+    events += a.window_events[w];
+    for (int i = 0; i < a.window_flips[w].size(); ++i) {
+      for (int j = 0; j < 8; ++j) {
+        counts[i][j] += a.window_flips[w][i][j];
+      }
+    }
   }
+  return events;
 }
 
 QVariant BinaryViewModel::headerData(int section, Qt::Orientation orientation, int role) const {
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <optional>
+
 #include <QApplication>
 #include <QList>
 #include <QSet>
@@ -21,6 +23,35 @@ public:
   QColor selection_color;
 };
 
+// Route-wide bit flip counts of every message, updated incrementally as events are merged.
+// the counts are also kept per time window to look up the activity of a time range.
+class BitActivity {
+public:
+  typedef std::vector<std::array<uint32_t, 8>> FlipCounts;
+  void update();
+  // returns the number of events, and the flip counts per byte and bit of the whole route or the time range.
+  size_t flipCounts(const MessageId &id, FlipCounts &counts) const;
+  size_t flipCounts(const MessageId &id, double min_sec, double max_sec, FlipCounts &counts) const;
+
+private:
+  struct Activity {
+    uint64_t first_mono_time = 0;
+    uint64_t last_mono_time = 0;
+    size_t events = 0;
+    FlipCounts flips;
+    std::vector<uint32_t> window_events;
+    std::vector<std::vector<std::array<uint16_t, 8>>> window_flips;
+    size_t first_window = 0;  // the windows before it only had dropped events
+  };
+  static void updateActivity(Activity &a, const CanEventList &events, uint64_t origin);
+  static void countFlips(Activity &a, uint64_t origin, const CanEvent *prev, CanEventList::const_iterator first, CanEventList::const_iterator last);
+  static void addFlips(Activity &a, size_t window, const CanEvent *prev, const CanEvent *e);
+  static void dropWindows(Activity &a, size_t last);
+
+  std::unordered_map<MessageId, Activity> activities;
+  uint64_t origin = 0;
+};
+
 class BinaryViewModel : public QAbstractTableModel {
 public:
   BinaryViewModel(QObject *parent) : QAbstractTableModel(parent) {}
@@ -49,6 +80,8 @@ public:
   };
   std::vector<Item> items;
 
+  const BitActivity *activity = nullptr;
+  std::optional<std::pair<double, double>> time_range;
   MessageId msg_id;
   int row_count = 0;
   const int column_count = 9;
@@ -60,6 +93,7 @@ class BinaryView : public QTableView {
 public:
   BinaryView(QWidget *parent = nullptr);
   void setMessage(const MessageId &message_id);
+  void setTimeRange(double min, double max, bool is_zoomed);
   void highlight(const cabana::Signal *sig);
   QSet<const cabana::Signal*> getOverlappingSignals() const;
   inline void updateState() { model->updateState(); }
@@ -86,6 +120,7 @@ private:
   void highlightPosition(const QPoint &pt);
 
   QModelIndex anchor_index;
+  BitActivity activity;
   BinaryViewModel *model;
   BinaryItemDelegate *delegate;
   const cabana::Signal *resize_sig = nullptr;
@@ -0,0 +1,76 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QRegularExpression>
+
+#include "tools/cabana/dbc/dbcmanager.h"
+#include "tools/cabana/export.h"
+#include "tools/replay/route.h"
+
+static bool openDBCFiles(const QStringList &dbc_files) {
+  QRegularExpression bus_regex("^(\\d+):(.+)$");
+  for (const auto &arg : dbc_files) {
+    SourceSet sources = SOURCE_ALL;
+    QString fn = arg;
+    if (auto match = bus_regex.match(arg); match.hasMatch()) {
+      sources = {match.captured(1).toInt()};
+      fn = match.captured(2);
+    }
+    if (!QFileInfo::exists(fn)) {
+      fn = QString("%1/%2.dbc").arg(OPENDBC_FILE_PATH, fn);
+    }
+    QString error;
+    if (!dbc()->open(sources, fn, &error)) {
+      qCritical() << "failed to open dbc" << arg << error;
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("cabana_export");
+
+  QCommandLineParser cmd_parser;
+  cmd_parser.setApplicationDescription("Decode the CAN signals of a route to a CSV or binary columnar file");
+  cmd_parser.addHelpOption();
+  cmd_parser.addPositionalArgument("route", "the drive to export");
+  cmd_parser.addPositionalArgument("output", "the output file, *.csv for CSV, binary columnar otherwise");
+  cmd_parser.addOption({"dbc", "dbc file or opendbc name, prefix with <bus>: to use it for one bus only. can be repeated", "dbc"});
+  cmd_parser.addOption({"signals", "comma separated list of <msg> or <msg>.<signal> to export, all signals by default", "signals"});
+  cmd_parser.addOption({"rate", "rows per second, 100 by default", "rate", "100"});
+  cmd_parser.addOption({"data_dir", "local directory with routes", "data_dir"});
+  cmd_parser.addOption({"qlog", "decode qlogs instead of rlogs"});
+  cmd_parser.process(app);
+
+  const QStringList args = cmd_parser.positionalArguments();
+  const double rate = cmd_parser.value("rate").toDouble();
+  if (args.size() != 2 || !cmd_parser.isSet("dbc") || rate <= 0) {
+    cmd_parser.showHelp(1);
+  }
+  if (!openDBCFiles(cmd_parser.values("dbc"))) {
+    return 1;
+  }
+
+  Route route(args[0], cmd_parser.value("data_dir"));
+  if (!route.load()) {
+    qCritical() << "failed to load route" << args[0];
+    return 1;
+  }
+  std::vector<std::string> log_files;
+  for (const auto &[n, files] : route.segments()) {
+    const QString &log = cmd_parser.isSet("qlog") ? (files.qlog.isEmpty() ? files.rlog : files.qlog)
+                                                  : (files.rlog.isEmpty() ? files.qlog : files.rlog);
+    if (!log.isEmpty()) {
+      log_files.push_back(log.toStdString());
+    }
+  }
+
+  // QString::SkipEmptyParts is deprecated since Qt 5.15
+  QStringList filters;
+  for (const auto &f : cmd_parser.value("signals").split(",")) {
+    if (!f.isEmpty()) filters.push_back(f);
+  }
+  return exportSignals(log_files, filters, rate, args[1]) ? 0 : 1;
+}
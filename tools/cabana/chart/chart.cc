@@ -272,43 +272,77 @@ void ChartView::updateSeriesPoints() {
 void ChartView::updateSeries(const cabana::Signal *sig, bool clear) {
   for (auto &s : sigs) {
     if (!sig || s.sig == sig) {
-      if (clear) {
-        s.vals.clear();
-        s.step_vals.clear();
-        s.last_value_mono_time = 0;
-      }
-      s.series->setColor(s.sig->color);
+      decodeSeries(s.msg_id, {&s}, clear);
+    }
+  }
+  publishSeries(sig);
+}
+
+// decodes the new events of a message for all its charted signals in one pass.
+// only touches the SigItem values, it is safe to call for different messages in parallel.
+void ChartView::decodeSeries(const MessageId &msg_id, const std::vector<SigItem *> &items, bool clear) {
+  uint64_t last_mono_time = std::numeric_limits<uint64_t>::max();
+  for (auto s : items) {
+    if (clear) {
+      s->vals.clear();
+      s->step_vals.clear();
+      s->last_value_mono_time = 0;
+    }
+    last_mono_time = std::min(last_mono_time, s->last_value_mono_time);
+  }
+
+  const auto &msgs = can->events(msg_id);
+  auto first = std::upper_bound(msgs.cbegin(), msgs.cend(), last_mono_time, [](uint64_t ts, auto e) {
+    return ts < e->mono_time;
+  });
+  const size_t count = std::distance(first, msgs.cend());
+  for (auto s : items) {
+    s->vals.reserve(s->vals.size() + count);
+    s->step_vals.reserve(s->step_vals.size() + count * 2);
+  }
 
-      const auto &msgs = can->events(s.msg_id);
-      s.vals.reserve(msgs.capacity());
-      s.step_vals.reserve(msgs.capacity() * 2);
-
-      auto first = std::upper_bound(msgs.cbegin(), msgs.cend(), s.last_value_mono_time, [](uint64_t ts, auto e) {
-        return ts < e->mono_time;
-      });
-      const double route_start_time = can->routeStartTime();
-      for (auto end = msgs.cend(); first != end; ++first) {
-        const CanEvent *e = *first;
-        double value = 0;
-        if (s.sig->getValue(e->dat, e->size, &value)) {
-          double ts = e->mono_time / 1e9 - route_start_time;  // seconds
-          s.vals.append({ts, value});
-          if (!s.step_vals.empty()) {
-            s.step_vals.append({ts, s.step_vals.back().y()});
-          }
-          s.step_vals.append({ts, value});
-          s.last_value_mono_time = e->mono_time;
+  const double route_start_time = can->routeStartTime();
+  for (auto end = msgs.cend(); first != end; ++first) {
+    const CanEvent *e = *first;
+    const double ts = e->mono_time / 1e9 - route_start_time;  // seconds
+    for (auto s : items) {
+      double value = 0;
+      if (e->mono_time > s->last_value_mono_time && s->sig->getValue(e->dat, e->size, &value)) {
+        s->vals.append({ts, value});
+        if (!s->step_vals.empty()) {
+          s->step_vals.append({ts, s->step_vals.back().y()});
         }
+        s->step_vals.append({ts, value});
+        s->last_value_mono_time = e->mono_time;
       }
-      if (!can->liveStreaming()) {
-        s.segment_tree.build(s.vals);
+    }
+  }
+
+  for (auto s : items) {
+    if (!can->liveStreaming()) {
+      s->segment_tree.build(s->vals);
+    } else if (!s->vals.isEmpty()) {
+      // the live stream drops its oldest events, trim their points in batches.
+      const double min_sec = can->firstEventMonoTime() / 1e9 - route_start_time;
+      auto vals_end = std::lower_bound(s->vals.begin(), s->vals.end(), min_sec, xLessThan);
+      if (std::distance(s->vals.begin(), vals_end) > std::max(1000, s->vals.size() / 8)) {
+        s->vals.erase(s->vals.begin(), vals_end);
+        s->step_vals.erase(s->step_vals.begin(), std::lower_bound(s->step_vals.begin(), s->step_vals.end(), min_sec, xLessThan));
       }
+    }
+  }
+}
+
+// hands the decoded values to QtCharts, must be called in the UI thread.
+void ChartView::publishSeries(const cabana::Signal *sig) {
+  for (auto &s : sigs) {
+    if (!sig || s.sig == sig) {
+      s.series->setColor(s.sig->color);
       s.series->replace(series_type == SeriesType::StepLine ? s.step_vals : s.vals);
     }
   }
   updateAxisY();
-  // invoke resetChartCache in ui thread
-  QMetaObject::invokeMethod(this, &ChartView::resetChartCache, Qt::QueuedConnection);
+  resetChartCache();
 }
 
 // auto zoom on yaxis
@@ -85,6 +85,8 @@ private:
   qreal niceNumber(qreal x, bool ceiling);
   QXYSeries *createSeries(SeriesType type, QColor color);
   void updateSeriesPoints();
+  static void decodeSeries(const MessageId &msg_id, const std::vector<SigItem *> &items, bool clear);
+  void publishSeries(const cabana::Signal *sig = nullptr);
   void removeIf(std::function<bool(const SigItem &)> predicate);
   inline void clearTrackPoints() { for (auto &s : sigs) s.track_pt = {}; }
 
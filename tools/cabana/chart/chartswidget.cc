@@ -92,6 +92,7 @@ ChartsWidget::ChartsWidget(QWidget *parent) : align_timer(this), auto_scroll_tim
   range_slider->setValue(max_chart_range);
   updateToolBar();
 
+  series_pool.setMaxThreadCount(std::min(QThread::idealThreadCount(), 4));
   align_timer.setSingleShot(true);
   QObject::connect(&align_timer, &QTimer::timeout, this, &ChartsWidget::alignCharts);
   QObject::connect(&auto_scroll_timer, &QTimer::timeout, this, &ChartsWidget::doAutoScroll);
@@ -148,10 +149,28 @@ void ChartsWidget::updateTabBar() {
 }
 
 void ChartsWidget::eventsMerged() {
-  QFutureSynchronizer<void> future_synchronizer;
-  bool clear = !can->liveStreaming();
+  // group the charted signals by message so the new events of each message are decoded once,
+  // signals of the same message can be spread across charts.
+  std::unordered_map<MessageId, std::vector<ChartView::SigItem *>> groups;
   for (auto c : charts) {
-    future_synchronizer.addFuture(QtConcurrent::run(c, &ChartView::updateSeries, nullptr, clear));
+    for (auto &s : c->sigs) {
+      groups[s.msg_id].push_back(&s);
+    }
+  }
+
+  const bool clear = !can->liveStreaming();
+  {
+    QFutureSynchronizer<void> future_synchronizer;
+    for (auto &[id, items] : groups) {
+      future_synchronizer.addFuture(QtConcurrent::run(&series_pool, [&id = id, &items = items, clear]() {
+        ChartView::decodeSeries(id, items, clear);
+      }));
+    }
+  }
+
+  // QtCharts is not thread safe, update the series and axes in the UI thread.
+  for (auto c : charts) {
+    c->publishSeries();
   }
 }
 
@@ -3,6 +3,7 @@
 #include <QGridLayout>
 #include <QLabel>
 #include <QScrollArea>
+#include <QThreadPool>
 #include <QTimer>
 #include <QUndoCommand>
 #include <QUndoStack>
@@ -94,6 +95,7 @@ private:
   ToolButton *remove_all_btn;
   QList<ChartView *> charts;
   std::unordered_map<int, QList<ChartView *>> tab_charts;
+  QThreadPool series_pool;  // decodes the series after events are merged
   TabBar *tabbar;
   ChartsContainer *charts_container;
   QScrollArea *charts_scroll;
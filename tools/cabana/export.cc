@@ -0,0 +1,239 @@
+#include "tools/cabana/export.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <numeric>
+
+#include <QtConcurrent>
+
+#include "tools/cabana/dbc/dbcmanager.h"
+#include "tools/replay/logreader.h"
+
+using ColumnKey = std::tuple<uint8_t, uint32_t, int>;  // source, address, signal index
+
+struct Sample {
+  uint64_t mono_time;
+  double value;
+};
+
+struct SegmentResult {
+  bool success = false;
+  std::map<ColumnKey, std::vector<Sample>> columns;
+};
+
+static bool isSelected(const QStringList &filters, const cabana::Msg *msg, const cabana::Signal *sig) {
+  return filters.isEmpty() || filters.contains(msg->name) || filters.contains(msg->name + "." + sig->name);
+}
+
+static SegmentResult decodeSegment(const std::string &log_file, const QStringList &filters) {
+  SegmentResult ret;
+  LogReader log;
+  if (!log.load(log_file, nullptr, {cereal::Event::Which::CAN}, true, 0, 3)) return ret;
+
+  // the selected signals of each message, looked up once per message id.
+  std::unordered_map<MessageId, std::vector<std::pair<const cabana::Signal *, std::vector<Sample> *>>> decoders;
+  for (const Event *e : log.events) {
+    if (e->which != cereal::Event::Which::CAN) continue;
+
+    for (const auto &c : e->event.getCan()) {
+      MessageId id = {.source = c.getSrc(), .address = c.getAddress()};
+      auto it = decoders.find(id);
+      if (it == decoders.end()) {
+        it = decoders.emplace(id, std::vector<std::pair<const cabana::Signal *, std::vector<Sample> *>>{}).first;
+        if (const auto msg = dbc()->msg(id)) {
+          const auto &sigs = msg->getSignals();
+          for (int i = 0; i < sigs.size(); ++i) {
+            if (isSelected(filters, msg, sigs[i])) {
+              it->second.push_back({sigs[i], &ret.columns[{id.source, id.address, i}]});
+            }
+          }
+        }
+      }
+
+      const auto dat = c.getDat();
+      double value = 0;
+      for (auto &[sig, samples] : it->second) {
+        // multiplexed signals only have a value if the multiplexor matches.
+        if (sig->getValue((const uint8_t *)dat.begin(), dat.size(), &value)) {
+          samples->push_back({e->mono_time, value});
+        }
+      }
+    }
+  }
+  ret.success = true;
+  return ret;
+}
+
+// appends the samples of a segment to the columns, only the last sample of a column before each row is kept.
+// the segments are appended in time order, the first one with samples sets the time of the first row.
+static void appendSegment(const SegmentResult &segment, std::map<ColumnKey, std::vector<Sample>> &columns, uint64_t &start_ts, uint64_t step) {
+  if (start_ts == UINT64_MAX) {
+    for (const auto &[_, samples] : segment.columns) {
+      if (!samples.empty()) start_ts = std::min(start_ts, samples.front().mono_time);
+    }
+  }
+  // the first row at or after ts
+  auto row = [&](uint64_t ts) { return ts > start_ts ? (ts - start_ts + step - 1) / step : 0; };
+  for (const auto &[key, samples] : segment.columns) {
+    auto &c = columns[key];
+    for (const Sample &s : samples) {
+      if (!c.empty() && row(c.back().mono_time) == row(s.mono_time)) {
+        c.back() = s;
+      } else {
+        c.push_back(s);
+      }
+    }
+  }
+}
+
+class ColumnWriter {
+public:
+  ColumnWriter(const std::vector<const std::vector<Sample> *> &columns, uint64_t start_ts, uint64_t step)
+      : columns(columns), cursors(columns.size(), 0), start_ts(start_ts), step(step) {}
+
+  // advance all columns to the row, returns the time of the row in seconds.
+  double seek(uint64_t row) {
+    const uint64_t ts = start_ts + row * step;
+    for (int i = 0; i < columns.size(); ++i) {
+      const auto &samples = *columns[i];
+      while (cursors[i] < samples.size() && samples[cursors[i]].mono_time <= ts) ++cursors[i];
+    }
+    return (row * step) / 1e9;
+  }
+  inline bool hasValue(int col) const { return cursors[col] > 0; }
+  inline double value(int col) const { return hasValue(col) ? (*columns[col])[cursors[col] - 1].value : NAN; }
+
+private:
+  const std::vector<const std::vector<Sample> *> &columns;
+  std::vector<size_t> cursors;
+  const uint64_t start_ts;
+  const uint64_t step;
+};
+
+static bool writeCSV(const std::string &fn, const QStringList &names, const std::vector<const std::vector<Sample> *> &columns,
+                     uint64_t start_ts, uint64_t step, uint64_t rows) {
+  std::ofstream fs(fn, std::ios::out);
+  fs << "time," << names.join(",").toStdString() << "\n";
+
+  ColumnWriter writer(columns, start_ts, step);
+  std::string line;
+  char buf[32];
+  for (uint64_t row = 0; row < rows && fs; ++row) {
+    line.clear();
+    snprintf(buf, sizeof(buf), "%.3f", writer.seek(row));
+    line += buf;
+    for (int i = 0; i < columns.size(); ++i) {
+      line += ',';
+      if (writer.hasValue(i)) {
+        snprintf(buf, sizeof(buf), "%.15g", writer.value(i));
+        line += buf;
+      }
+    }
+    line += '\n';
+    fs.write(line.data(), line.size());
+  }
+  return bool(fs);
+}
+
+static bool writeBinary(const std::string &fn, const QStringList &names, const std::vector<const std::vector<Sample> *> &columns,
+                        uint64_t start_ts, uint64_t step, uint64_t rows) {
+  std::ofstream fs(fn, std::ios::binary | std::ios::out);
+  const char magic[8] = "CABCOL1";
+  const uint32_t column_count = columns.size() + 1;
+  fs.write(magic, sizeof(magic));
+  fs.write((const char *)&column_count, sizeof(column_count));
+  fs.write((const char *)&rows, sizeof(rows));
+  for (const auto &name : QStringList{"time"} + names) {
+    const QByteArray str = name.toUtf8();
+    const uint16_t size = str.size();
+    fs.write((const char *)&size, sizeof(size));
+    fs.write(str.data(), size);
+  }
+
+  std::vector<double> values(rows);
+  for (uint64_t row = 0; row < rows; ++row) {
+    values[row] = (row * step) / 1e9;
+  }
+  fs.write((const char *)values.data(), values.size() * sizeof(double));
+
+  // resample each column in parallel, one batch of columns at a time to bound the memory.
+  const int batch_size = QThreadPool::globalInstance()->maxThreadCount();
+  for (int first = 0; first < columns.size() && fs; first += batch_size) {
+    std::vector<int> batch(std::min<int>(batch_size, columns.size() - first));
+    std::iota(batch.begin(), batch.end(), first);
+    std::vector<std::vector<double>> batch_values(batch.size());
+    QtConcurrent::blockingMap(batch, [&](int col) {
+      auto &out = batch_values[col - first];
+      out.resize(rows);
+      const auto &samples = *columns[col];
+      size_t cursor = 0;
+      for (uint64_t row = 0; row < rows; ++row) {
+        const uint64_t ts = start_ts + row * step;
+        while (cursor < samples.size() && samples[cursor].mono_time <= ts) ++cursor;
+        out[row] = cursor > 0 ? samples[cursor - 1].value : NAN;
+      }
+    });
+    for (const auto &out : batch_values) {
+      fs.write((const char *)out.data(), out.size() * sizeof(double));
+    }
+  }
+  return bool(fs);
+}
+
+bool exportSignals(const std::vector<std::string> &log_files, const QStringList &filters, double rate, const QString &output) {
+  // decode all segments in parallel, and append them to the columns in time order as soon as the earlier ones
+  // are done. the columns are resampled to the rows while appending, so the memory scales with rows x columns.
+  const uint64_t step = 1e9 / rate;
+  std::map<ColumnKey, std::vector<Sample>> columns;
+  uint64_t start_ts = UINT64_MAX;
+  std::vector<SegmentResult> results(log_files.size());
+  std::vector<bool> decoded(log_files.size(), false);
+  std::vector<int> segments(log_files.size());
+  std::iota(segments.begin(), segments.end(), 0);
+  std::mutex lock;
+  int finished = 0, appended = 0;
+  QtConcurrent::blockingMap(segments, [&](int i) {
+    SegmentResult result = decodeSegment(log_files[i], filters);
+    std::lock_guard lk(lock);
+    fprintf(stderr, "decoded %d/%zu segments\n", ++finished, log_files.size());
+    results[i] = std::move(result);
+    decoded[i] = true;
+    for (; appended < results.size() && decoded[appended]; ++appended) {
+      if (!results[appended].success) {
+        qWarning() << "failed to load" << log_files[appended].c_str();
+      }
+      appendSegment(results[appended], columns, start_ts, step);
+      results[appended] = {};
+    }
+  });
+
+  uint64_t end_ts = 0;
+  QStringList names;
+  std::vector<const std::vector<Sample> *> column_samples;
+  for (const auto &[key, samples] : columns) {
+    if (samples.empty()) continue;
+
+    const auto &[source, address, sig_idx] = key;
+    const auto msg = dbc()->msg({.source = source, .address = address});
+    names.push_back(QString("%1:%2.%3").arg(source).arg(msg->name, msg->getSignals()[sig_idx]->name));
+    column_samples.push_back(&samples);
+    end_ts = std::max(end_ts, samples.back().mono_time);
+  }
+  if (column_samples.empty()) {
+    qCritical() << "no signals to export";
+    return false;
+  }
+
+  const uint64_t rows = (end_ts - start_ts) / step + 1;
+  const std::string fn = output.toStdString();
+  bool ret = output.endsWith(".csv", Qt::CaseInsensitive) ? writeCSV(fn, names, column_samples, start_ts, step, rows)
+                                                         : writeBinary(fn, names, column_samples, start_ts, step, rows);
+  if (!ret) {
+    qCritical() << "failed to write" << output;
+    return false;
+  }
+  fprintf(stderr, "exported %d signals, %llu rows to %s\n", names.size(), (unsigned long long)rows, fn.c_str());
+  return true;
+}
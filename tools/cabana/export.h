@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <QStringList>
+
+// Decodes the CAN signals of the logs into a time-aligned table with one column per bus and signal.
+// rows are sampled at a fixed rate, each cell holds the latest value of the signal at that time.
+//
+// CSV: "time,<bus>:<msg>.<signal>,...", cells are empty before the first value of a signal.
+// binary: column-major float64 table, NaN before the first value of a signal.
+//   char magic[8] = "CABCOL1"; uint32_t columns; uint64_t rows;
+//   columns x {uint16_t name_size; char name[name_size];}
+//   columns x rows x double, the first column is the time in seconds.
+//
+// the signals are decoded with the opened dbc files, filters select <msg> or <msg>.<signal>, all signals if empty.
+// the output is CSV if its name ends with .csv, binary otherwise.
+bool exportSignals(const std::vector<std::string> &log_files, const QStringList &filters, double rate, const QString &output);
@@ -2,6 +2,7 @@
 
 #include <QPainter>
 #include <QPushButton>
+#include <QtConcurrent>
 #include <QVBoxLayout>
 
 #include "tools/cabana/commands.h"
@@ -9,17 +10,23 @@
 
 QVariant HistoryLogModel::data(const QModelIndex &index, int role) const {
   const bool show_signals = display_signals_mode && sigs.size() > 0;
-  const auto &m = messages[index.row()];
+  const int event_idx = eventIndex(index.row());
+  const CanEvent *e = can->events(msg_id)[event_idx];
   if (role == Qt::DisplayRole) {
     if (index.column() == 0) {
-      return QString::number((m.mono_time / (double)1e9) - can->routeStartTime(), 'f', 2);
+      return QString::number((e->mono_time / (double)1e9) - can->routeStartTime(), 'f', 2);
     }
     int i = index.column() - 1;
-    return show_signals ? QString::number(m.sig_values[i], 'f', sigs[i]->precision) : toHex(m.data);
+    if (show_signals) {
+      double value = 0;
+      sigs[i]->getValue(e->dat, e->size, &value);
+      return QString::number(value, 'f', sigs[i]->precision);
+    }
+    return toHex(QByteArray((const char *)e->dat, e->size));
   } else if (role == ColorsRole) {
-    return QVariant::fromValue(m.colors);
+    return QVariant::fromValue(colorsAt(event_idx));
   } else if (role == BytesRole) {
-    return m.data;
+    return QByteArray((const char *)e->dat, e->size);
   } else if (role == Qt::TextAlignmentRole) {
     return (uint32_t)(Qt::AlignRight | Qt::AlignVCenter);
   }
@@ -36,12 +43,15 @@ void HistoryLogModel::refresh(bool fetch_message) {
   if (auto dbc_msg = dbc()->msg(msg_id)) {
     sigs = dbc_msg->getSignals();
   }
-  last_fetch_time = 0;
-  has_more_data = true;
-  messages.clear();
-  hex_colors = {};
+  filtered_index.clear();
+  indexed_events = 0;
+  last_indexed_time = 0;
+  drop_count = can->dropCount();
+  colors_cache.clear();
+  row_count = 0;
   if (fetch_message) {
-    updateState();
+    updateFilteredIndex();
+    row_count = visibleRowCount();
   }
   endResetModel();
 }
@@ -83,8 +93,58 @@ void HistoryLogModel::setDisplayType(int type) {
 }
 
 void HistoryLogModel::segmentsMerged() {
+  const auto &events = can->events(msg_id);
+  int dropped = 0;
+  if (drop_count != can->dropCount()) {
+    drop_count = can->dropCount();
+    dropped = droppedEvents();
+  } else if (indexed_events > events.size() || (indexed_events > 0 && events[indexed_events - 1]->mono_time != last_indexed_time)) {
+    dropped = -1;
+  }
+  if (dropped < 0) {
+    // events were inserted before the indexed ones, row indexes are no longer valid.
+    refresh();
+    return;
+  }
+  if (dropped > 0) {
+    removeDroppedRows(dropped);
+  }
   if (!dynamic_mode) {
-    has_more_data = true;
+    updateFilteredIndex();
+    updateState();
+  }
+}
+
+// Live streams drop their oldest events from the front and append newer ones. Returns how many
+// indexed events were dropped, or -1 if the events changed in any other way.
+int HistoryLogModel::droppedEvents() const {
+  const auto &events = can->events(msg_id);
+  auto it = std::upper_bound(events.cbegin(), events.cend(), last_indexed_time, [](uint64_t ts, auto e) {
+    return ts < e->mono_time;
+  });
+  const size_t kept = std::distance(events.cbegin(), it);
+  return kept <= indexed_events ? indexed_events - kept : -1;
+}
+
+void HistoryLogModel::removeDroppedRows(int dropped) {
+  int dropped_entries = dropped;
+  if (filter_cmp) {
+    dropped_entries = std::lower_bound(filtered_index.cbegin(), filtered_index.cend(), dropped) - filtered_index.cbegin();
+  }
+  // the oldest rows are at the bottom in dynamic mode.
+  const int removed = std::min(dropped_entries, row_count);
+  if (removed > 0) {
+    dynamic_mode ? beginRemoveRows({}, row_count - removed, row_count - 1) : beginRemoveRows({}, 0, removed - 1);
+  }
+  if (filter_cmp) {
+    filtered_index.erase(filtered_index.begin(), filtered_index.begin() + dropped_entries);
+    for (auto &i : filtered_index) i -= dropped;
+  }
+  indexed_events -= dropped;
+  colors_cache.clear();
+  if (removed > 0) {
+    row_count -= removed;
+    endRemoveRows();
   }
 }
 
@@ -95,83 +155,89 @@ void HistoryLogModel::setFilter(int sig_idx, const QString &value, std::function
 }
 
 void HistoryLogModel::updateState() {
-  uint64_t current_time = (can->lastMessage(msg_id).ts + can->routeStartTime()) * 1e9 + 1;
-  auto new_msgs = dynamic_mode ? fetchData(current_time, last_fetch_time) : fetchData(0);
-  if (!new_msgs.empty()) {
-    beginInsertRows({}, 0, new_msgs.size() - 1);
-    messages.insert(messages.begin(), std::move_iterator(new_msgs.begin()), std::move_iterator(new_msgs.end()));
+  if (dynamic_mode) {
+    updateFilteredIndex();
+  }
+  int count = visibleRowCount();
+  if (count > row_count) {
+    // dynamic mode shows the newest message first.
+    dynamic_mode ? beginInsertRows({}, 0, count - row_count - 1) : beginInsertRows({}, row_count, count - 1);
+    row_count = count;
     endInsertRows();
+  } else if (count < row_count) {
+    beginResetModel();
+    row_count = count;
+    endResetModel();
   }
-  has_more_data = new_msgs.size() >= batch_size;
-  last_fetch_time = current_time;
 }
 
-void HistoryLogModel::fetchMore(const QModelIndex &parent) {
-  if (!messages.empty()) {
-    auto new_msgs = fetchData(messages.back().mono_time);
-    if (!new_msgs.empty()) {
-      beginInsertRows({}, messages.size(), messages.size() + new_msgs.size() - 1);
-      messages.insert(messages.end(), std::move_iterator(new_msgs.begin()), std::move_iterator(new_msgs.end()));
-      endInsertRows();
-    }
-    has_more_data = new_msgs.size() >= batch_size;
+int HistoryLogModel::visibleRowCount() const {
+  const auto &events = can->events(msg_id);
+  size_t n = events.size();
+  if (dynamic_mode) {
+    uint64_t current_time = (can->lastMessage(msg_id).ts + can->routeStartTime()) * 1e9 + 1;
+    n = std::lower_bound(events.cbegin(), events.cend(), current_time, [](auto e, uint64_t ts) {
+      return e->mono_time < ts;
+    }) - events.cbegin();
+  }
+  if (filter_cmp) {
+    n = std::lower_bound(filtered_index.cbegin(), filtered_index.cend(), n) - filtered_index.cbegin();
   }
+  return n;
 }
 
-template <class InputIt>
-std::deque<HistoryLogModel::Message> HistoryLogModel::fetchData(InputIt first, InputIt last, uint64_t min_time) {
-  std::deque<HistoryLogModel::Message> msgs;
-  QVector<double> values(sigs.size());
-  for (; first != last && (*first)->mono_time > min_time; ++first) {
-    const CanEvent *e = *first;
-    for (int i = 0; i < sigs.size(); ++i) {
-      sigs[i]->getValue(e->dat, e->size, &values[i]);
+int HistoryLogModel::eventIndex(int row) const {
+  int i = dynamic_mode ? row_count - 1 - row : row;
+  return filter_cmp ? filtered_index[i] : i;
+}
+
+void HistoryLogModel::updateFilteredIndex() {
+  const auto &events = can->events(msg_id);
+  if (filter_cmp && indexed_events < events.size()) {
+    struct Chunk {
+      size_t begin, end;
+      std::vector<uint32_t> matches;
+    };
+    const size_t chunk_size = 16 * 1024;
+    std::vector<Chunk> chunks;
+    for (size_t i = indexed_events; i < events.size(); i += chunk_size) {
+      chunks.push_back({.begin = i, .end = std::min(i + chunk_size, events.size())});
     }
-    if (!filter_cmp || filter_cmp(values[filter_sig_idx], filter_value)) {
-      auto &m = msgs.emplace_back();
-      m.mono_time = e->mono_time;
-      m.data = QByteArray((const char *)e->dat, e->size);
-      m.sig_values = values;
-      if (msgs.size() >= batch_size && min_time == 0) {
-        return msgs;
+
+    const cabana::Signal *sig = sigs[filter_sig_idx];
+    QtConcurrent::blockingMap(chunks, [&](Chunk &c) {
+      for (size_t i = c.begin; i < c.end; ++i) {
+        double value = 0;
+        if (sig->getValue(events[i]->dat, events[i]->size, &value) && filter_cmp(value, filter_value)) {
+          c.matches.push_back(i);
+        }
       }
+    });
+    for (const auto &c : chunks) {
+      filtered_index.insert(filtered_index.end(), c.matches.cbegin(), c.matches.cend());
     }
   }
-  return msgs;
+  indexed_events = events.size();
+  last_indexed_time = events.empty() ? 0 : events.back()->mono_time;
 }
 
-std::deque<HistoryLogModel::Message> HistoryLogModel::fetchData(uint64_t from_time, uint64_t min_time) {
+const QVector<QColor> &HistoryLogModel::colorsAt(int event_idx) const {
   const auto &events = can->events(msg_id);
-  const auto freq = can->lastMessage(msg_id).freq;
-  const bool update_colors = !display_signals_mode || sigs.empty();
-
-  const auto speed = can->getSpeed();
-  if (dynamic_mode) {
-    auto first = std::upper_bound(events.rbegin(), events.rend(), from_time, [](uint64_t ts, auto e) {
-      return ts > e->mono_time;
-    });
-    auto msgs = fetchData(first, events.rend(), min_time);
-    if (update_colors && (min_time > 0 || messages.empty())) {
-      for (auto it = msgs.rbegin(); it != msgs.rend(); ++it) {
-        hex_colors.compute(it->data.data(), it->data.size(), it->mono_time / (double)1e9, speed, nullptr, freq);
-        it->colors = hex_colors.colors;
-      }
+  auto it = colors_cache.find(events[event_idx]);
+  if (it == colors_cache.end()) {
+    if (colors_cache.size() > 1000) {
+      colors_cache.clear();
     }
-    return msgs;
-  } else {
-    assert(min_time == 0);
-    auto first = std::upper_bound(events.cbegin(), events.cend(), from_time, [](uint64_t ts, auto e) {
-      return ts < e->mono_time;
-    });
-    auto msgs = fetchData(first, events.cend(), 0);
-    if (update_colors) {
-      for (auto it = msgs.begin(); it != msgs.end(); ++it) {
-        hex_colors.compute(it->data.data(), it->data.size(), it->mono_time / (double)1e9, speed, nullptr, freq);
-        it->colors = hex_colors.colors;
-      }
+    // replay enough of the preceding frames to recover the change state and fade-out.
+    const double freq = can->lastMessage(msg_id).freq;
+    const int history = std::clamp<int>(freq * 2, 8, 256);
+    CanData hex_colors;
+    for (int i = std::max(0, event_idx - history); i <= event_idx; ++i) {
+      hex_colors.compute(events[i]->dat, events[i]->size, events[i]->mono_time / (double)1e9, nullptr, freq);
     }
-    return msgs;
+    it = colors_cache.insert(events[event_idx], hex_colors.colors(can->getSpeed()));
   }
+  return it.value();
 }
 
 // HeaderView
@@ -242,6 +308,7 @@ LogsWidget::LogsWidget(QWidget *parent) : QFrame(parent) {
   logs->horizontalHeader()->setDefaultAlignment(Qt::AlignRight | (Qt::Alignment)Qt::TextWordWrap);
   logs->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
   logs->verticalHeader()->setVisible(false);
+  logs->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
   logs->setFrameShape(QFrame::NoFrame);
 
   QObject::connect(display_type_cb, qOverload<int>(&QComboBox::activated), [this](int index) {
@@ -300,7 +367,7 @@ void LogsWidget::updateState() {
 }
 
 void LogsWidget::showEvent(QShowEvent *event) {
-  if (dynamic_mode->isChecked() || model->canFetchMore({}) && model->rowCount() == 0) {
+  if (dynamic_mode->isChecked() || model->rowCount() == 0) {
     model->refresh();
   }
 }
@@ -1,6 +1,5 @@
 #pragma once
 
-#include <deque>
 #include <QCheckBox>
 #include <QComboBox>
 #include <QHeaderView>
@@ -28,9 +27,7 @@ public:
   void setFilter(int sig_idx, const QString &value, std::function<bool(double, double)> cmp);
   QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
   QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
-  void fetchMore(const QModelIndex &parent) override;
-  inline bool canFetchMore(const QModelIndex &parent) const override { return has_more_data; }
-  int rowCount(const QModelIndex &parent = QModelIndex()) const override { return messages.size(); }
+  int rowCount(const QModelIndex &parent = QModelIndex()) const override { return row_count; }
   int columnCount(const QModelIndex &parent = QModelIndex()) const override {
     return display_signals_mode && !sigs.empty() ? sigs.size() + 1 : 2;
   }
@@ -42,26 +39,24 @@ public slots:
   void segmentsMerged();
 
 public:
-  struct Message {
-    uint64_t mono_time = 0;
-    QVector<double> sig_values;
-    QByteArray data;
-    QVector<QColor> colors;
-  };
-
-  template <class InputIt>
-  std::deque<HistoryLogModel::Message> fetchData(InputIt first, InputIt last, uint64_t min_time);
-  std::deque<Message> fetchData(uint64_t from_time, uint64_t min_time = 0);
+  // rows are not copied, they are indexes into can->events(msg_id) and materialized in data().
+  int eventIndex(int row) const;
+  int visibleRowCount() const;
+  void updateFilteredIndex();
+  int droppedEvents() const;
+  void removeDroppedRows(int dropped);
+  const QVector<QColor> &colorsAt(int event_idx) const;
 
   MessageId msg_id;
-  CanData hex_colors;
-  bool has_more_data = true;
-  const int batch_size = 50;
+  int row_count = 0;
   int filter_sig_idx = -1;
   double filter_value = 0;
-  uint64_t last_fetch_time = 0;
   std::function<bool(double, double)> filter_cmp = nullptr;
-  std::deque<Message> messages;
+  std::vector<uint32_t> filtered_index;
+  size_t indexed_events = 0;
+  uint64_t last_indexed_time = 0;
+  size_t drop_count = 0;  // can->dropCount() when the events were indexed
+  mutable QHash<const CanEvent *, QVector<QColor>> colors_cache;
   std::vector<cabana::Signal *> sigs;
   bool dynamic_mode = true;
   bool display_signals_mode = true;
@@ -365,6 +365,7 @@ void MainWindow::streamStarted() {
 }
 
 void MainWindow::eventsMerged() {
+  updateStatus();
   if (!can->liveStreaming() && std::exchange(car_fingerprint, can->carFingerprint()) != car_fingerprint) {
     video_dock->setWindowTitle(tr("ROUTE: %1  FINGERPRINT: %2")
                                     .arg(can->routeName())
@@ -568,7 +569,10 @@ void MainWindow::updateDownloadProgress(uint64_t cur, uint64_t total, bool succe
 }
 
 void MainWindow::updateStatus() {
-  status_label->setText(tr("Cached Minutes:%1 FPS:%2").arg(settings.max_cached_minutes).arg(settings.fps));
+  status_label->setText(tr("Cached Minutes:%1 FPS:%2 Memory:%3")
+                            .arg(settings.max_cached_minutes)
+                            .arg(settings.fps)
+                            .arg(can ? formattedDataSize(can->memoryUsage()).c_str() : "0"));
 }
 
 void MainWindow::dockCharts(bool dock) {
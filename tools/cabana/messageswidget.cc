@@ -184,7 +184,7 @@ QVariant MessageListModel::data(const QModelIndex &index, int role) const {
       case Column::DATA: return id.source != INVALID_SOURCE ? toHex(can_data.dat) : "N/A";
     }
   } else if (role == ColorsRole) {
-    QVector<QColor> colors = can_data.colors;
+    QVector<QColor> colors = can_data.colors(can->getSpeed());
     if (!suppressed_bytes.empty()) {
       for (int i = 0; i < colors.size(); i++) {
         if (suppressed_bytes.contains({id, i})) {
@@ -204,8 +204,32 @@ QVariant MessageListModel::data(const QModelIndex &index, int role) const {
   return {};
 }
 
-void MessageListModel::setFilterStrings(const QMap<int, QString> &filters) {
-  filter_str = filters;
+// Parse out filter string into a range (e.g. "1" -> {1, 1}, "1-3" -> {1, 3}, "1-" -> {1, inf})
+static bool parseRange(const QString &filter, uint32_t &min, uint32_t &max, int base = 10) {
+  min = std::numeric_limits<unsigned int>::min();
+  max = std::numeric_limits<unsigned int>::max();
+  auto s = filter.split('-');
+  bool ok = s.size() >= 1 && s.size() <= 2;
+  if (ok && !s[0].isEmpty()) min = s[0].toUInt(&ok, base);
+  if (ok && s.size() == 1) {
+    max = min;
+  } else if (ok && s.size() == 2 && !s[1].isEmpty()) {
+    max = s[1].toUInt(&ok, base);
+  }
+  return ok;
+}
+
+void MessageListModel::setFilterStrings(const QMap<int, QString> &filters_str) {
+  filter_str = filters_str;
+  filters.clear();
+  for (auto it = filter_str.cbegin(); it != filter_str.cend(); ++it) {
+    Filter f = {.column = it.key(), .text = it.value()};
+    f.re = QRegularExpression(f.text, QRegularExpression::CaseInsensitiveOption | QRegularExpression::DotMatchesEverythingOption);
+    f.re.optimize();
+    f.is_range = parseRange(f.text, f.min, f.max, f.column == Column::ADDRESS ? 16 : 10);
+    filters.push_back(f);
+  }
+  has_dynamic_filter = filter_str.contains(Column::FREQ) || filter_str.contains(Column::COUNT) || filter_str.contains(Column::DATA);
   fetchData();
 }
 
@@ -217,61 +241,60 @@ void MessageListModel::dbcModified() {
   fetchData();
 }
 
+bool MessageListModel::lessThan(const MessageId &l, const MessageId &r) const {
+  auto less = [this](const MessageId &l, const MessageId &r) {
+    switch (sort_column) {
+      case Column::NAME: return std::tie(sort_keys.at(l).name, l) < std::tie(sort_keys.at(r).name, r);
+      case Column::SOURCE: return std::pair{l.source, l} < std::pair{r.source, r};
+      case Column::ADDRESS: return std::pair{l.address, l} < std::pair{r.address, r};
+      case Column::FREQ: return std::pair{sort_keys.at(l).freq, l} < std::pair{sort_keys.at(r).freq, r};
+      case Column::COUNT: return std::pair{sort_keys.at(l).count, l} < std::pair{sort_keys.at(r).count, r};
+      default: return l < r;
+    }
+  };
+  return sort_order == Qt::AscendingOrder ? less(l, r) : less(r, l);
+}
+
 void MessageListModel::sortMessages(std::vector<MessageId> &new_msgs) {
-  if (sort_column == Column::NAME) {
-    std::sort(new_msgs.begin(), new_msgs.end(), [=](auto &l, auto &r) {
-      auto ll = std::pair{msgName(l), l};
-      auto rr = std::pair{msgName(r), r};
-      return sort_order == Qt::AscendingOrder ? ll < rr : ll > rr;
-    });
-  } else if (sort_column == Column::SOURCE) {
-    std::sort(new_msgs.begin(), new_msgs.end(), [=](auto &l, auto &r) {
-      auto ll = std::pair{l.source, l};
-      auto rr = std::pair{r.source, r};
-      return sort_order == Qt::AscendingOrder ? ll < rr : ll > rr;
-    });
-  } else if (sort_column == Column::ADDRESS) {
-    std::sort(new_msgs.begin(), new_msgs.end(), [=](auto &l, auto &r) {
-      auto ll = std::pair{l.address, l};
-      auto rr = std::pair{r.address, r};
-      return sort_order == Qt::AscendingOrder ? ll < rr : ll > rr;
-    });
-  } else if (sort_column == Column::FREQ) {
-    std::sort(new_msgs.begin(), new_msgs.end(), [=](auto &l, auto &r) {
-      auto ll = std::pair{can->lastMessage(l).freq, l};
-      auto rr = std::pair{can->lastMessage(r).freq, r};
-      return sort_order == Qt::AscendingOrder ? ll < rr : ll > rr;
-    });
-  } else if (sort_column == Column::COUNT) {
-    std::sort(new_msgs.begin(), new_msgs.end(), [=](auto &l, auto &r) {
-      auto ll = std::pair{can->lastMessage(l).count, l};
-      auto rr = std::pair{can->lastMessage(r).count, r};
-      return sort_order == Qt::AscendingOrder ? ll < rr : ll > rr;
-    });
-  }
+  std::sort(new_msgs.begin(), new_msgs.end(), [this](auto &l, auto &r) { return lessThan(l, r); });
 }
 
-static bool parseRange(const QString &filter, uint32_t value, int base = 10) {
-  // Parse out filter string into a range (e.g. "1" -> {1, 1}, "1-3" -> {1, 3}, "1-" -> {1, inf})
-  unsigned int min = std::numeric_limits<unsigned int>::min();
-  unsigned int max = std::numeric_limits<unsigned int>::max();
-  auto s = filter.split('-');
-  bool ok = s.size() >= 1 && s.size() <= 2;
-  if (ok && !s[0].isEmpty()) min = s[0].toUInt(&ok, base);
-  if (ok && s.size() == 1) {
-    max = min;
-  } else if (ok && s.size() == 2 && !s[1].isEmpty()) {
-    max = s[1].toUInt(&ok, base);
+// Restore the sort order after the keys of some rows changed, returns true if rows were moved.
+bool MessageListModel::repairSortOrder() {
+  auto less = [this](auto &l, auto &r) { return lessThan(l, r); };
+  if (std::is_sorted(msgs.cbegin(), msgs.cend(), less)) return false;
+
+  emit layoutAboutToBeChanged();
+  const auto old_msgs = msgs;
+  // the order barely changes between updates, an insertion sort only moves the rows that are out of place.
+  for (int i = 1; i < msgs.size(); ++i) {
+    const MessageId id = msgs[i];
+    int j = i;
+    for (; j > 0 && lessThan(id, msgs[j - 1]); --j) {
+      msgs[j] = msgs[j - 1];
+    }
+    msgs[j] = id;
+  }
+
+  const auto persistent = persistentIndexList();
+  if (!persistent.isEmpty()) {
+    std::unordered_map<MessageId, int> rows;
+    for (int i = 0; i < msgs.size(); ++i) {
+      rows[msgs[i]] = i;
+    }
+    for (const auto &idx : persistent) {
+      changePersistentIndex(idx, index(rows[old_msgs[idx.row()]], idx.column()));
+    }
   }
-  return ok && value >= min && value <= max;
+  emit layoutChanged();
+  return true;
 }
 
-bool MessageListModel::matchMessage(const MessageId &id, const CanData &data, const QMap<int, QString> &filters) {
+bool MessageListModel::matchMessage(const MessageId &id, const CanData &data) const {
   bool match = true;
   for (auto it = filters.cbegin(); it != filters.cend() && match; ++it) {
-    const QString &txt = it.value();
-    QRegularExpression re(txt, QRegularExpression::CaseInsensitiveOption | QRegularExpression::DotMatchesEverythingOption);
-    switch (it.key()) {
+    const auto &re = it->re;
+    switch (it->column) {
       case Column::NAME: {
         const auto msg = dbc()->msg(id);
         match = re.match(msg ? msg->name : UNTITLED).hasMatch();
@@ -279,23 +302,24 @@ bool MessageListModel::matchMessage(const MessageId &id, const CanData &data, co
         break;
       }
       case Column::SOURCE:
-        match = parseRange(txt, id.source);
+        match = it->is_range && id.source >= it->min && id.source <= it->max;
         break;
       case Column::ADDRESS: {
         match = re.match(QString::number(id.address, 16)).hasMatch();
-        match |= parseRange(txt, id.address, 16);
+        match |= it->is_range && id.address >= it->min && id.address <= it->max;
         break;
       }
       case Column::FREQ:
         // TODO: Hide stale messages?
-        match = parseRange(txt, data.freq);
+        match = it->is_range && (uint32_t)data.freq >= it->min && (uint32_t)data.freq <= it->max;
         break;
       case Column::COUNT:
-        match = parseRange(txt, data.count);
+        match = it->is_range && data.count >= it->min && data.count <= it->max;
         break;
       case Column::DATA: {
-        match = QString(data.dat.toHex()).contains(txt, Qt::CaseInsensitive);
-        match |= re.match(QString(data.dat.toHex())).hasMatch();
+        const QString hex = data.dat.toHex();
+        match = hex.contains(it->text, Qt::CaseInsensitive);
+        match |= re.match(hex).hasMatch();
         match |= re.match(QString(data.dat.toHex(' '))).hasMatch();
         break;
       }
@@ -308,10 +332,12 @@ void MessageListModel::fetchData() {
   std::vector<MessageId> new_msgs;
   new_msgs.reserve(can->last_msgs.size() + dbc_address.size());
 
+  sort_keys.clear();
   auto address = dbc_address;
   for (auto it = can->last_msgs.cbegin(); it != can->last_msgs.cend(); ++it) {
-    if (filter_str.isEmpty() || matchMessage(it.key(), it.value(), filter_str)) {
+    if (filters.empty() || matchMessage(it.key(), it.value())) {
       new_msgs.push_back(it.key());
+      sort_keys[it.key()] = {msgName(it.key()), it.value().freq, it.value().count};
     }
     address.remove(it.key().address);
   }
@@ -319,8 +345,9 @@ void MessageListModel::fetchData() {
   // merge all DBC messages
   for (auto &addr : address) {
     MessageId id{.source = INVALID_SOURCE, .address = addr};
-    if (filter_str.isEmpty() || matchMessage(id, {}, filter_str)) {
+    if (filters.empty() || matchMessage(id, {})) {
       new_msgs.push_back(id);
+      sort_keys[id] = {msgName(id)};
     }
   }
 
@@ -333,14 +360,58 @@ void MessageListModel::fetchData() {
   }
 }
 
+// Re-evaluate the dynamic filters of the updated messages only, returns true if rows were added or removed.
+bool MessageListModel::updateFilteredMessages(const QHash<MessageId, CanData> *new_msgs) {
+  bool changed = false;
+  std::vector<MessageId> new_filtered;
+  new_filtered.reserve(msgs.size());
+  for (const auto &id : msgs) {
+    auto it = new_msgs->constFind(id);
+    if (it == new_msgs->cend() || matchMessage(id, it.value())) {
+      new_filtered.push_back(id);
+    } else {
+      sort_keys.erase(id);
+      changed = true;
+    }
+  }
+  for (auto it = new_msgs->cbegin(); it != new_msgs->cend(); ++it) {
+    if (!sort_keys.count(it.key()) && matchMessage(it.key(), it.value())) {
+      new_filtered.push_back(it.key());
+      sort_keys[it.key()] = {msgName(it.key()), it.value().freq, it.value().count};
+      changed = true;
+    }
+  }
+  if (!changed) return false;
+
+  sortMessages(new_filtered);
+  beginResetModel();
+  msgs = std::move(new_filtered);
+  endResetModel();
+  return true;
+}
+
 void MessageListModel::msgsReceived(const QHash<MessageId, CanData> *new_msgs, bool has_new_ids) {
-  if (has_new_ids || filter_str.contains(Column::FREQ) || filter_str.contains(Column::COUNT) || filter_str.contains(Column::DATA)) {
+  if (has_new_ids) {
     fetchData();
+  } else {
+    const bool dynamic_sort = sort_column == Column::FREQ || sort_column == Column::COUNT;
+    if (dynamic_sort) {
+      for (auto it = new_msgs->cbegin(); it != new_msgs->cend(); ++it) {
+        if (auto key = sort_keys.find(it.key()); key != sort_keys.end()) {
+          key->second.freq = it.value().freq;
+          key->second.count = it.value().count;
+        }
+      }
+    }
+    bool reset = has_dynamic_filter && updateFilteredMessages(new_msgs);
+    if (!reset && dynamic_sort) {
+      repairSortOrder();
+    }
   }
+
   for (int i = 0; i < msgs.size(); ++i) {
     if (new_msgs->contains(msgs[i])) {
-      for (int col = Column::FREQ; col < columnCount(); ++col)
-        emit dataChanged(index(i, col), index(i, col), {Qt::DisplayRole});
+      emit dataChanged(index(i, Column::FREQ), index(i, columnCount() - 1), {Qt::DisplayRole});
     }
   }
 }
@@ -7,6 +7,7 @@
 #include <QLabel>
 #include <QLineEdit>
 #include <QMenu>
+#include <QRegularExpression>
 #include <QSet>
 #include <QTreeView>
 
@@ -44,10 +45,30 @@ public:
   QSet<std::pair<MessageId, int>> suppressed_bytes;
 
 private:
+  // filters are compiled once when they change
+  struct Filter {
+    int column;
+    QString text;
+    QRegularExpression re;
+    bool is_range = false;
+    uint32_t min = 0, max = 0;
+  };
+  struct SortKey {
+    QString name;
+    double freq = 0;
+    uint32_t count = 0;
+  };
+
+  bool lessThan(const MessageId &l, const MessageId &r) const;
   void sortMessages(std::vector<MessageId> &new_msgs);
-  bool matchMessage(const MessageId &id, const CanData &data, const QMap<int, QString> &filters);
+  bool repairSortOrder();
+  bool matchMessage(const MessageId &id, const CanData &data) const;
+  bool updateFilteredMessages(const QHash<MessageId, CanData> *new_msgs);
 
   QMap<int, QString> filter_str;
+  std::vector<Filter> filters;
+  bool has_dynamic_filter = false;
+  std::unordered_map<MessageId, SortKey> sort_keys;
   QSet<uint32_t> dbc_address;
   int sort_column = 0;
   Qt::SortOrder sort_order = Qt::AscendingOrder;
@@ -21,6 +21,8 @@ void Settings::save() {
   QSettings s("settings", QSettings::IniFormat);
   s.setValue("fps", fps);
   s.setValue("max_cached_minutes", max_cached_minutes);
+  s.setValue("live_retention_minutes", live_retention_minutes);
+  s.setValue("live_retention_mb", live_retention_mb);
   s.setValue("chart_height", chart_height);
   s.setValue("chart_range", chart_range);
   s.setValue("chart_column_count", chart_column_count);
@@ -45,6 +47,8 @@ void Settings::load() {
   QSettings s("settings", QSettings::IniFormat);
   fps = s.value("fps", 10).toInt();
   max_cached_minutes = s.value("max_cached_minutes", 30).toInt();
+  live_retention_minutes = s.value("live_retention_minutes", 0).toInt();
+  live_retention_mb = s.value("live_retention_mb", 2048).toInt();
   chart_height = s.value("chart_height", 200).toInt();
   chart_range = s.value("chart_range", 3 * 60).toInt();
   chart_column_count = s.value("chart_column_count", 1).toInt();
@@ -93,6 +97,19 @@ SettingsDlg::SettingsDlg(QWidget *parent) : QDialog(parent) {
   cached_minutes->setSingleStep(1);
   cached_minutes->setValue(settings.max_cached_minutes);
   form_layout->addRow(tr("Max Cached Minutes"), cached_minutes);
+
+  live_retention_minutes = new QSpinBox(this);
+  live_retention_minutes->setRange(0, 24 * 60);
+  live_retention_minutes->setSpecialValueText(tr("Unlimited"));
+  live_retention_minutes->setValue(settings.live_retention_minutes);
+  form_layout->addRow(tr("Live Stream Retention (minutes)"), live_retention_minutes);
+
+  live_retention_mb = new QSpinBox(this);
+  live_retention_mb->setRange(0, 64 * 1024);
+  live_retention_mb->setSingleStep(256);
+  live_retention_mb->setSpecialValueText(tr("Unlimited"));
+  live_retention_mb->setValue(settings.live_retention_mb);
+  form_layout->addRow(tr("Live Stream Memory Limit (MB)"), live_retention_mb);
   main_layout->addWidget(groupbox);
 
   groupbox = new QGroupBox("New Signal Settings");
@@ -160,6 +177,8 @@ void SettingsDlg::save() {
     utils::setTheme(settings.theme);
   }
   settings.max_cached_minutes = cached_minutes->value();
+  settings.live_retention_minutes = live_retention_minutes->value();
+  settings.live_retention_mb = live_retention_mb->value();
   settings.chart_series_type = chart_series_type->currentIndex();
   settings.chart_height = chart_height->value();
   settings.log_livestream = log_livestream->isChecked();
@@ -28,6 +28,8 @@ public:
 
   int fps = 10;
   int max_cached_minutes = 30;
+  int live_retention_minutes = 0;
+  int live_retention_mb = 2048;
   int chart_height = 200;
   int chart_column_count = 1;
   int chart_range = 3 * 60; // 3 minutes
@@ -59,6 +61,8 @@ public:
   void save();
   QSpinBox *fps;
   QSpinBox *cached_minutes;
+  QSpinBox *live_retention_minutes;
+  QSpinBox *live_retention_mb;
   QSpinBox *chart_height;
   QComboBox *chart_series_type;
   QComboBox *theme;
@@ -59,7 +59,7 @@ void AbstractStream::updateEvent(const MessageId &id, double sec, const uint8_t
   std::lock_guard lk(mutex);
   auto mask_it = masks.find(id);
   std::vector<uint8_t> *mask = mask_it == masks.end() ? nullptr : &mask_it->second;
-  all_msgs[id].compute((const char *)data, size, sec, getSpeed(), mask);
+  all_msgs[id].compute(data, size, sec, mask, 0, firstEventMonoTime() / 1e9 - routeStartTime());
   if (!new_msgs->contains(id)) {
     new_msgs->insert(id, {});
   }
@@ -81,8 +81,8 @@ bool AbstractStream::postEvents() {
   return false;
 }
 
-const std::vector<const CanEvent *> &AbstractStream::events(const MessageId &id) const {
-  static std::vector<const CanEvent *> empty_events;
+const CanEventList &AbstractStream::events(const MessageId &id) const {
+  static CanEventList empty_events;
   auto it = events_.find(id);
   return it != events_.end() ? it->second : empty_events;
 }
@@ -110,9 +110,10 @@ void AbstractStream::updateLastMsgsTo(double sec) {
     if (it != ev.crend()) {
       double ts = (*it)->mono_time / 1e9 - routeStartTime();
       auto &m = all_msgs[id];
-      m.compute((const char *)(*it)->dat, (*it)->size, ts, getSpeed(), mask);
+      m.compute((*it)->dat, (*it)->size, ts, mask);
       m.count = std::distance(it, ev.crend());
-      m.freq = m.count / std::max(1.0, ts);
+      // live streams may have dropped their oldest events
+      m.freq = m.count / std::max(1.0, ts - (firstEventMonoTime() / 1e9 - routeStartTime()));
     }
   }
 
@@ -127,6 +128,10 @@ void AbstractStream::updateLastMsgsTo(double sec) {
 }
 
 void AbstractStream::mergeEvents(std::vector<Event *>::const_iterator first, std::vector<Event *>::const_iterator last) {
+  mergeEvents(std::vector<MemoryBlock>{serializeEvents(first, last)});
+}
+
+AbstractStream::MemoryBlock AbstractStream::serializeEvents(std::vector<Event *>::const_iterator first, std::vector<Event *>::const_iterator last) {
   size_t memory_size = 0;
   size_t events_cnt = 0;
   for (auto it = first; it != last; ++it) {
@@ -137,29 +142,65 @@ void AbstractStream::mergeEvents(std::vector<Event *>::const_iterator first, std
       }
     }
   }
-  if (memory_size == 0) return;
+  if (memory_size == 0) return {};
+
+  std::shared_ptr<char> data(new char[memory_size], std::default_delete<char[]>());
+  char *ptr = data.get();
+  for (auto it = first; it != last; ++it) {
+    if ((*it)->which == cereal::Event::Which::CAN) {
+      ptr += serializeCanEvents((*it)->mono_time, (*it)->event.getCan(), ptr);
+    }
+  }
+  return {data, memory_size, events_cnt};
+}
+
+size_t AbstractStream::serializeCanEvents(uint64_t mono_time, const capnp::List<cereal::CanData>::Reader &can_data, char *ptr) {
+  const char *begin = ptr;
+  for (const auto &c : can_data) {
+    CanEvent *e = (CanEvent *)ptr;
+    e->src = c.getSrc();
+    e->address = c.getAddress();
+    e->mono_time = mono_time;
+    auto dat = c.getDat();
+    e->size = dat.size();
+    memcpy(e->dat, (uint8_t *)dat.begin(), e->size);
+    ptr += sizeof(CanEvent) + sizeof(uint8_t) * e->size;
+  }
+  return ptr - begin;
+}
+
+void AbstractStream::mergeEvents(std::unique_ptr<char[]> data, size_t size, size_t events_cnt) {
+  if (events_cnt == 0) return;
+
+  std::vector<MemoryBlock> blocks;
+  blocks.push_back({std::shared_ptr<char>(data.release(), std::default_delete<char[]>()), size, events_cnt});
+  mergeEvents(std::move(blocks));
+}
+
+// take over blocks of serialized CanEvents, the events must be sorted by mono_time across blocks.
+void AbstractStream::mergeEvents(std::vector<MemoryBlock> &&blocks) {
+  size_t events_cnt = 0;
+  for (const auto &block : blocks) {
+    events_cnt += block.events;
+  }
+  if (events_cnt == 0) return;
 
-  char *ptr = memory_blocks.emplace_back(new char[memory_size]).get();
   std::unordered_map<MessageId, std::deque<const CanEvent *>> new_events_map;
   std::vector<const CanEvent *> new_events;
   new_events.reserve(events_cnt);
-  for (auto it = first; it != last; ++it) {
-    if ((*it)->which == cereal::Event::Which::CAN) {
-      uint64_t ts = (*it)->mono_time;
-      for (const auto &c : (*it)->event.getCan()) {
-        CanEvent *e = (CanEvent *)ptr;
-        e->src = c.getSrc();
-        e->address = c.getAddress();
-        e->mono_time = ts;
-        auto dat = c.getDat();
-        e->size = dat.size();
-        memcpy(e->dat, (uint8_t *)dat.begin(), e->size);
-
-        new_events_map[{.source = e->src, .address = e->address}].push_back(e);
-        new_events.push_back(e);
-        ptr += sizeof(CanEvent) + sizeof(uint8_t) * e->size;
-      }
+  for (auto &block : blocks) {
+    if (block.events == 0) continue;
+
+    const char *ptr = block.data.get();
+    for (size_t i = 0; i < block.events; ++i) {
+      const CanEvent *e = (const CanEvent *)ptr;
+      new_events_map[{.source = e->src, .address = e->address}].push_back(e);
+      new_events.push_back(e);
+      block.last_mono_time = std::max(block.last_mono_time, e->mono_time);
+      ptr += sizeof(CanEvent) + sizeof(uint8_t) * e->size;
     }
+    events_memory_size += block.size;
+    memory_blocks.push_back(std::move(block));
   }
 
   bool append = new_events.front()->mono_time > lastest_event_ts;
@@ -177,9 +218,48 @@ void AbstractStream::mergeEvents(std::vector<Event *>::const_iterator first, std
   all_events_.insert(pos, new_events.cbegin(), new_events.cend());
 
   lastest_event_ts = all_events_.back()->mono_time;
+  oldest_event_ts = all_events_.front()->mono_time;
   emit eventsMerged();
 }
 
+// Drop the oldest memory blocks until the events fit in the retention window.
+// The lists are sorted by mono_time, so the events up to the newest event of the dropped blocks are
+// removed from the front. Removing moves all the remaining events, so at least an eighth of them are
+// dropped at once and the window is exceeded by up to that much.
+size_t AbstractStream::dropEvents(uint64_t min_mono_time, size_t max_memory) {
+  size_t drop_blocks = 0, drop_events = 0, memory = memoryUsage();
+  uint64_t drop_time = 0;
+  for (; drop_blocks + 1 < memory_blocks.size(); ++drop_blocks) {
+    const auto &block = memory_blocks[drop_blocks];
+    if (block.last_mono_time >= min_mono_time && memory <= max_memory) break;
+
+    memory -= block.size + block.events * 2 * sizeof(const CanEvent *);
+    drop_events += block.events;
+    drop_time = std::max(drop_time, block.last_mono_time);
+  }
+  if (drop_blocks == 0 || drop_events < all_events_.size() / 8) return 0;
+
+  auto erase_front = [drop_time](CanEventList &list) {
+    auto it = std::upper_bound(list.begin(), list.end(), drop_time, [](uint64_t ts, const CanEvent *e) {
+      return ts < e->mono_time;
+    });
+    list.erase(list.begin(), it);
+  };
+  for (auto &[_, e] : events_) {
+    erase_front(e);
+  }
+  size_t dropped = all_events_.size();
+  erase_front(all_events_);
+  dropped -= all_events_.size();
+  oldest_event_ts = all_events_.empty() ? 0 : all_events_.front()->mono_time;
+  ++drop_count;
+  for (size_t i = 0; i < drop_blocks; ++i) {
+    events_memory_size -= memory_blocks.front().size;
+    memory_blocks.pop_front();
+  }
+  return dropped;
+}
+
 // CanData
 
 constexpr int periodic_threshold = 10;
@@ -196,65 +276,94 @@ static inline QColor blend(const QColor &a, const QColor &b) {
   return QColor((a.red() + b.red()) / 2, (a.green() + b.green()) / 2, (a.blue() + b.blue()) / 2, (a.alpha() + b.alpha()) / 2);
 }
 
-void CanData::compute(const char *can_data, const int size, double current_sec, double playback_speed, const std::vector<uint8_t> *mask, uint32_t in_freq) {
+void CanData::compute(const uint8_t *can_data, const int size, double current_sec, const std::vector<uint8_t> *mask,
+                      double in_freq, double first_sec) {
   ts = current_sec;
   ++count;
-  const double sec_to_first_event = current_sec - (can->allEvents().front()->mono_time / 1e9 - can->routeStartTime());
-  freq = in_freq == 0 ? count / std::max(1.0, sec_to_first_event) : in_freq;
+  freq = in_freq == 0 ? count / std::max(1.0, current_sec - first_sec) : in_freq;
   if (dat.size() != size) {
     dat.resize(size);
     bit_change_counts.resize(size);
-    colors = QVector(size, QColor(0, 0, 0, 0));
     last_change_t.assign(size, ts);
     last_delta.resize(size);
     same_delta_counter.resize(size);
+    last_change_type.assign(size, ChangeType::None);
+    periodic_change_counter.assign(size, 0);
   } else {
-    bool lighter = settings.theme == DARK_THEME;
-    const QColor &cyan = !lighter ? CYAN : CYAN_LIGHTER;
-    const QColor &red = !lighter ? RED : RED_LIGHTER;
-    const QColor &greyish_blue = !lighter ? GREYISH_BLUE : GREYISH_BLUE_LIGHTER;
-
-    for (int i = 0; i < size; ++i) {
-      const uint8_t mask_byte = (mask && i < mask->size()) ? (~((*mask)[i])) : 0xff;
-      const uint8_t last = dat[i] & mask_byte;
-      const uint8_t cur = can_data[i] & mask_byte;
-      const int delta = cur - last;
+    const uint8_t *last_data = (const uint8_t *)dat.constData();
+    // compare 8 bytes at a time, most frames only change a few bytes.
+    for (int i = 0; i < size; i += 8) {
+      const int n = std::min(8, size - i);
+      uint64_t last_word = 0, cur_word = 0, mask_word = ~0ULL;
+      memcpy(&last_word, last_data + i, n);
+      memcpy(&cur_word, can_data + i, n);
+      if (mask && i < mask->size()) {
+        uint64_t m = 0;
+        memcpy(&m, mask->data() + i, std::min<int>(n, mask->size() - i));
+        mask_word = ~m;
+      }
 
-      if (last != cur) {
-        double delta_t = ts - last_change_t[i];
+      for (uint64_t changed = (last_word ^ cur_word) & mask_word; changed != 0; /**/) {
+        const int shift = (__builtin_ctzll(changed) / 8) * 8;
+        const int j = i + shift / 8;
+        const uint8_t last = (last_word >> shift) & (mask_word >> shift) & 0xff;
+        const uint8_t cur = (cur_word >> shift) & (mask_word >> shift) & 0xff;
+        const int delta = cur - last;
+        const double delta_t = ts - last_change_t[j];
 
         // Keep track if signal is changing randomly, or mostly moving in the same direction
-        if (std::signbit(delta) == std::signbit(last_delta[i])) {
-          same_delta_counter[i] = std::min(16, same_delta_counter[i] + 1);
+        if (std::signbit(delta) == std::signbit(last_delta[j])) {
+          same_delta_counter[j] = std::min(16, same_delta_counter[j] + 1);
         } else {
-          same_delta_counter[i] = std::max(0, same_delta_counter[i] - 4);
+          same_delta_counter[j] = std::max(0, same_delta_counter[j] - 4);
         }
 
         // Mostly moves in the same direction, color based on delta up/down
-        if (delta_t * freq > periodic_threshold || same_delta_counter[i] > 8) {
-          // Last change was while ago, choose color based on delta up or down
-          colors[i] = (cur > last) ? cyan : red;
+        if (delta_t * freq > periodic_threshold || same_delta_counter[j] > 8) {
+          last_change_type[j] = cur > last ? ChangeType::Increasing : ChangeType::Decreasing;
+          periodic_change_counter[j] = 0;
         } else {
-          // Periodic changes
-          colors[i] = blend(colors[i], greyish_blue);
+          periodic_change_counter[j] = std::min(8, periodic_change_counter[j] + 1);
         }
 
         // Track bit level changes
-        const uint8_t tmp = (cur ^ last);
-        for (int bit = 0; bit < 8; bit++) {
-          if (tmp & (1 << bit)) {
-            bit_change_counts[i][bit] += 1;
-          }
+        const uint8_t tmp = cur ^ last;
+        auto &counts = bit_change_counts[j];
+        for (int bit = 0; bit < 8; ++bit) {
+          counts[bit] += (tmp >> bit) & 1;
         }
 
-        last_change_t[i] = ts;
-        last_delta[i] = delta;
-      } else {
-        // Fade out
-        float alpha_delta = 1.0 / (freq + 1) / (fade_time * playback_speed);
-        colors[i].setAlphaF(std::max(0.0, colors[i].alphaF() - alpha_delta));
+        last_change_t[j] = ts;
+        last_delta[j] = delta;
+        changed &= ~(0xffULL << shift);
       }
     }
   }
   memcpy(dat.data(), can_data, size);
 }
+
+QVector<QColor> CanData::colors(double playback_speed) const {
+  bool lighter = settings.theme == DARK_THEME;
+  const QColor &cyan = !lighter ? CYAN : CYAN_LIGHTER;
+  const QColor &red = !lighter ? RED : RED_LIGHTER;
+  const QColor &greyish_blue = !lighter ? GREYISH_BLUE : GREYISH_BLUE_LIGHTER;
+
+  QVector<QColor> result(dat.size(), QColor(0, 0, 0, 0));
+  for (int i = 0; i < last_change_type.size() && i < result.size(); ++i) {
+    QColor &color = result[i];
+    if (last_change_type[i] != ChangeType::None) {
+      color = last_change_type[i] == ChangeType::Increasing ? cyan : red;
+    }
+    // Periodic changes
+    for (int n = 0; n < periodic_change_counter[i]; ++n) {
+      color = blend(color, greyish_blue);
+    }
+    // Fade out by the number of frames received since the last change
+    if (color.alpha() > 0) {
+      double unchanged_frames = (ts - last_change_t[i]) * freq;
+      float alpha_delta = unchanged_frames / (freq + 1) / (fade_time * playback_speed);
+      color.setAlphaF(std::max(0.0, color.alphaF() - alpha_delta));
+    }
+  }
+  return result;
+}
@@ -13,17 +13,29 @@
 #include "tools/replay/replay.h"
 
 struct CanData {
-  void compute(const char *dat, const int size, double current_sec, double playback_speed, const std::vector<uint8_t> *mask, uint32_t in_freq = 0);
+  // ingest: called for every CAN frame on the stream thread, keep it cheap.
+  // without in_freq, the frequency is the count over the time since first_sec, the first event of the stream.
+  void compute(const uint8_t *can_data, const int size, double current_sec, const std::vector<uint8_t> *mask,
+               double in_freq = 0, double first_sec = 0);
+  // presentation: resolve the per-byte change state into colors, only for visible rows.
+  QVector<QColor> colors(double playback_speed = 1.0) const;
+
+  enum ChangeType : uint8_t {
+    None = 0,
+    Increasing,
+    Decreasing,
+  };
 
   double ts = 0.;
   uint32_t count = 0;
   double freq = 0;
   QByteArray dat;
-  QVector<QColor> colors;
   std::vector<double> last_change_t;
   std::vector<std::array<uint32_t, 8>> bit_change_counts;
   std::vector<int> last_delta;
   std::vector<int> same_delta_counter;
+  std::vector<ChangeType> last_change_type;
+  std::vector<uint8_t> periodic_change_counter;
 };
 
 struct CanEvent {
@@ -34,6 +46,8 @@ struct CanEvent {
   uint8_t dat[];
 };
 
+typedef std::vector<const CanEvent *> CanEventList;
+
 class AbstractStream : public QObject {
   Q_OBJECT
 
@@ -55,8 +69,13 @@ public:
   virtual double getSpeed() { return 1; }
   virtual bool isPaused() const { return false; }
   virtual void pause(bool pause) {}
-  const std::vector<const CanEvent *> &allEvents() const { return all_events_; }
-  const std::vector<const CanEvent *> &events(const MessageId &id) const;
+  const CanEventList &allEvents() const { return all_events_; }
+  const CanEventList &events(const MessageId &id) const;
+  const std::unordered_map<MessageId, CanEventList> &eventsMap() const { return events_; }
+  uint64_t firstEventMonoTime() const { return oldest_event_ts; }
+  // incremented every time the oldest events are dropped
+  size_t dropCount() const { return drop_count; }
+  size_t memoryUsage() const { return events_memory_size + all_events_.size() * 2 * sizeof(const CanEvent *); }
   virtual const std::vector<std::tuple<int, int, TimelineType>> getTimeline() { return {}; }
 
 signals:
@@ -74,7 +93,19 @@ public:
   SourceSet sources;
 
 protected:
+  // serialized CanEvents, either on the heap or mmapped from a cache file.
+  struct MemoryBlock {
+    std::shared_ptr<char> data;
+    size_t size = 0;
+    size_t events = 0;
+    uint64_t last_mono_time = 0;  // set by mergeEvents
+  };
+  static MemoryBlock serializeEvents(std::vector<Event *>::const_iterator first, std::vector<Event *>::const_iterator last);
   void mergeEvents(std::vector<Event *>::const_iterator first, std::vector<Event *>::const_iterator last);
+  void mergeEvents(std::unique_ptr<char[]> data, size_t size, size_t events_cnt);
+  void mergeEvents(std::vector<MemoryBlock> &&blocks);
+  static size_t serializeCanEvents(uint64_t mono_time, const capnp::List<cereal::CanData>::Reader &can_data, char *ptr);
+  size_t dropEvents(uint64_t min_mono_time, size_t max_memory);
   bool postEvents();
   uint64_t lastEventMonoTime() const { return lastest_event_ts; }
   void updateEvent(const MessageId &id, double sec, const uint8_t *data, uint8_t size);
@@ -83,12 +114,16 @@ protected:
   void updateLastMsgsTo(double sec);
 
   uint64_t lastest_event_ts = 0;
+  std::atomic<uint64_t> oldest_event_ts = 0;  // read by the stream thread
+  size_t drop_count = 0;
   std::atomic<bool> processing = false;
   std::unique_ptr<QHash<MessageId, CanData>> new_msgs;
   QHash<MessageId, CanData> all_msgs;
-  std::unordered_map<MessageId, std::vector<const CanEvent *>> events_;
-  std::vector<const CanEvent *> all_events_;
-  std::deque<std::unique_ptr<char[]>> memory_blocks;
+  std::unordered_map<MessageId, CanEventList> events_;
+  CanEventList all_events_;
+
+  std::deque<MemoryBlock> memory_blocks;
+  size_t events_memory_size = 0;
   std::mutex mutex;
   std::unordered_map<MessageId, std::vector<uint8_t>> masks;
 };
@@ -1,31 +1,153 @@
 #include "tools/cabana/streams/livestream.h"
 
+#include <bzlib.h>
+
+#include <condition_variable>
+#include <thread>
+
+// Writes the live stream into per-minute bz2 compressed rlogs on a background thread.
+// the stream thread only appends the message to a bounded queue, messages are dropped (and counted) when it's full.
 struct LiveStream::Logger {
-  Logger() : start_ts(seconds_since_epoch()), segment_num(-1) {}
+  struct Chunk {
+    int segment;
+    std::string data;
+  };
+  static constexpr size_t CHUNK_SIZE = 1024 * 1024;
+  static constexpr size_t MAX_QUEUED_BYTES = 64 * 1024 * 1024;
+
+  Logger() : start_ts(seconds_since_epoch()), thread(&Logger::run, this) {}
+  ~Logger() {
+    {
+      std::lock_guard lk(lock);
+      exit = true;
+    }
+    cv.notify_one();
+    thread.join();
+  }
 
+  // called in streamThread
   void write(const char *data, const size_t size) {
     int n = (seconds_since_epoch() - start_ts) / 60.0;
-    if (std::exchange(segment_num, n) != segment_num) {
+    bool notify = false;
+    {
+      std::lock_guard lk(lock);
+      if (queued_bytes + size > MAX_QUEUED_BYTES) {
+        dropped_bytes += size;
+        return;
+      }
+      if (queue.empty() || queue.back().segment != n || queue.back().data.size() >= CHUNK_SIZE) {
+        // wake up the writer only once a chunk is complete.
+        notify = !queue.empty();
+        queue.push_back({n, {}});
+        queue.back().data.reserve(CHUNK_SIZE);
+      }
+      queue.back().data.append(data, size);
+      queued_bytes += size;
+    }
+    if (notify) {
+      cv.notify_one();
+    }
+  }
+
+  // called in UI thread
+  void reportDrops() {
+    std::lock_guard lk(lock);
+    if (dropped_bytes > 0) {
+      qWarning() << "LiveStream: logger dropped" << dropped_bytes << "bytes," << queued_bytes << "bytes backlogged";
+      dropped_bytes = 0;
+    }
+  }
+
+private:
+  void run() {
+    std::unique_lock lk(lock);
+    while (true) {
+      // flush the incomplete chunk at least once per second.
+      cv.wait_for(lk, std::chrono::seconds(1), [this]() { return exit || queue.size() > 1; });
+      bool done = exit;
+      std::deque<Chunk> chunks;
+      chunks.swap(queue);
+      lk.unlock();
+
+      size_t written = 0;
+      for (const auto &c : chunks) {
+        writeChunk(c);
+        written += c.data.size();
+      }
+
+      lk.lock();
+      queued_bytes -= written;
+      if (done) break;
+    }
+    closeFile();
+  }
+
+  void writeChunk(const Chunk &c) {
+    if (failed) return;
+
+    if (std::exchange(segment_num, c.segment) != c.segment) {
+      closeFile();
       QString dir = QString("%1/%2--%3")
                         .arg(settings.log_path)
                         .arg(QDateTime::fromSecsSinceEpoch(start_ts).toString("yyyy-MM-dd--hh-mm-ss"))
-                        .arg(n);
+                        .arg(c.segment);
       util::create_directories(dir.toStdString(), 0755);
-      fs.reset(new std::ofstream((dir + "/rlog").toStdString(), std::ios::binary | std::ios::out));
+      if ((file = fopen((dir + "/rlog.bz2").toStdString().c_str(), "wb"))) {
+        int bzerror;
+        bz_file = BZ2_bzWriteOpen(&bzerror, file, 9, 0, 30);
+        if (bzerror != BZ_OK) {
+          closeFile();
+        }
+      }
+    }
+    if (bz_file) {
+      int bzerror;
+      BZ2_bzWrite(&bzerror, bz_file, (void *)c.data.data(), c.data.size());
+      if (bzerror != BZ_OK) {
+        // the stream is unusable after an error, stop logging instead of writing a truncated file.
+        qWarning() << "LiveStream: failed to write the log, logging stopped. bzerror:" << bzerror;
+        closeFile(true);
+        failed = true;
+      }
     }
+  }
 
-    fs->write(data, size);
+  void closeFile(bool abandon = false) {
+    if (bz_file) {
+      int bzerror;
+      BZ2_bzWriteClose(&bzerror, bz_file, abandon, nullptr, nullptr);
+      bz_file = nullptr;
+    }
+    if (file) {
+      fclose(file);
+      file = nullptr;
+    }
   }
 
-  std::unique_ptr<std::ofstream> fs;
-  int segment_num;
   uint64_t start_ts;
+  std::mutex lock;
+  std::condition_variable cv;
+  std::deque<Chunk> queue;
+  size_t queued_bytes = 0;
+  uint64_t dropped_bytes = 0;
+  bool exit = false;
+
+  // writer thread only
+  int segment_num = -1;
+  FILE *file = nullptr;
+  BZFILE *bz_file = nullptr;
+  bool failed = false;
+  std::thread thread;
 };
 
 LiveStream::LiveStream(QObject *parent) : AbstractStream(parent) {
   if (settings.log_livestream) {
     logger = std::make_unique<Logger>();
   }
+  ring.resize(RING_SIZE);
+  for (auto &slot : ring) {
+    slot.data.reserve(2048);
+  }
   stream_thread = new QThread(this);
 
   QObject::connect(&settings, &Settings::changed, this, &LiveStream::startUpdateTimer);
@@ -58,22 +180,81 @@ void LiveStream::handleEvent(const char *data, const size_t size) {
     logger->write(data, size);
   }
 
-  std::lock_guard lk(lock);
-  auto &msg = receivedMessages.emplace_back(data, size);
-  receivedEvents.push_back(msg.event);
+  Event event(aligned_buf.align(data, size));
+  if (event.which != cereal::Event::Which::CAN) return;
+
+  size_t pos = write_pos.load(std::memory_order_relaxed);
+  if (pos - read_pos.load(std::memory_order_acquire) == RING_SIZE) {
+    // the UI thread is not keeping up, drop the message instead of blocking the receiver.
+    overruns.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  auto can_data = event.event.getCan();
+  auto &slot = ring[pos % RING_SIZE];
+  size_t memory_size = 0;
+  for (const auto &c : can_data) {
+    memory_size += sizeof(CanEvent) + sizeof(uint8_t) * c.getDat().size();
+  }
+  slot.data.resize(memory_size);
+  serializeCanEvents(event.mono_time, can_data, slot.data.data());
+  slot.events = can_data.size();
+  write_pos.store(pos + 1, std::memory_order_release);
+}
+
+// called in UI thread
+void LiveStream::mergeReceivedEvents() {
+  size_t first = read_pos.load(std::memory_order_relaxed);
+  size_t last = write_pos.load(std::memory_order_acquire);
+  size_t memory_size = 0, events_cnt = 0;
+  for (size_t i = first; i != last; ++i) {
+    memory_size += ring[i % RING_SIZE].data.size();
+    events_cnt += ring[i % RING_SIZE].events;
+  }
+
+  std::unique_ptr<char[]> data;
+  if (events_cnt > 0) {
+    data = std::make_unique<char[]>(memory_size);
+    char *ptr = data.get();
+    for (size_t i = first; i != last; ++i) {
+      const auto &slot = ring[i % RING_SIZE];
+      memcpy(ptr, slot.data.data(), slot.data.size());
+      ptr += slot.data.size();
+    }
+  }
+  // hand the slots back to the stream thread before the (slower) merge.
+  read_pos.store(last, std::memory_order_release);
+  mergeEvents(std::move(data), memory_size, events_cnt);
+
+  if (uint64_t n = overruns.exchange(0, std::memory_order_relaxed)) {
+    qWarning() << "LiveStream: dropped" << n << "messages, the UI thread is not keeping up with the stream";
+  }
+  if (logger) {
+    logger->reportDrops();
+  }
 }
 
 void LiveStream::timerEvent(QTimerEvent *event) {
   if (event->timerId() == timer_id) {
     {
+      // drop events out of the retention window before merging, eventsMerged notifies both.
+      uint64_t retention_ns = settings.live_retention_minutes * 60 * 1e9;
+      uint64_t min_mono_time = retention_ns > 0 && lastEventMonoTime() > retention_ns ? lastEventMonoTime() - retention_ns : 0;
+      size_t max_memory = settings.live_retention_mb > 0 ? settings.live_retention_mb * 1024ULL * 1024ULL : SIZE_MAX;
+      size_t dropped = dropEvents(min_mono_time, max_memory);
+
       // merge events received from live stream thread.
-      std::lock_guard lk(lock);
-      mergeEvents(receivedEvents.cbegin(), receivedEvents.cend());
-      receivedEvents.clear();
-      receivedMessages.clear();
+      size_t merged = events_memory_size;
+      mergeReceivedEvents();
+      if (dropped > 0 && merged == events_memory_size) {
+        emit eventsMerged();
+      }
     }
     if (!all_events_.empty()) {
-      begin_event_ts = all_events_.front()->mono_time;
+      // keep the time base fixed while the oldest events are dropped.
+      if (begin_event_ts == 0) {
+        begin_event_ts = all_events_.front()->mono_time;
+      }
       updateEvents();
       return;
     }
@@ -118,7 +299,7 @@ void LiveStream::updateEvents() {
 void LiveStream::seekTo(double sec) {
   sec = std::max(0.0, sec);
   first_update_ts = nanos_since_boot();
-  current_event_ts = first_event_ts = std::min<uint64_t>(sec * 1e9 + begin_event_ts, lastEventMonoTime());
+  current_event_ts = first_event_ts = std::clamp<uint64_t>(sec * 1e9 + begin_event_ts, firstEventMonoTime(), lastEventMonoTime());
   post_last_event = (first_event_ts == lastEventMonoTime());
   emit seekedTo((current_event_ts - begin_event_ts) / 1e9);
 }
@@ -26,21 +26,24 @@ protected:
 private:
   void startUpdateTimer();
   void timerEvent(QTimerEvent *event) override;
+  void mergeReceivedEvents();
   void updateEvents();
 
-  struct Msg {
-    Msg(const char *data, const size_t size) {
-      event = ::new Event(aligned_buf.align(data, size));
-    }
-    ~Msg() { ::delete event; }
-    Event *event;
-    AlignedBuffer aligned_buf;
+  // single-producer/single-consumer ring between the stream thread and the UI thread.
+  // the stream thread parses the CAN frames of a message into the slot at write_pos and publishes it,
+  // the UI thread copies all published slots into one memory block and hands them back by advancing read_pos.
+  struct Slot {
+    std::vector<char> data;
+    size_t events = 0;
   };
+  static constexpr size_t RING_SIZE = 1024;
+  std::vector<Slot> ring;
+  alignas(64) std::atomic<size_t> write_pos{0};
+  alignas(64) std::atomic<size_t> read_pos{0};
+  std::atomic<uint64_t> overruns{0};
+  AlignedBuffer aligned_buf;  // only used in stream thread
 
-  std::mutex lock;
   QThread *stream_thread;
-  std::vector<Event *> receivedEvents;
-  std::deque<Msg> receivedMessages;
 
   int timer_id;
   QBasicTimer update_timer;
@@ -1,10 +1,62 @@
 #include "tools/cabana/streams/replaystream.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <QLabel>
 #include <QFileDialog>
 #include <QGridLayout>
 #include <QMessageBox>
 #include <QPushButton>
+#include <QSaveFile>
+#include <QtConcurrent>
+
+#include "tools/replay/filereader.h"
+
+// The CAN cache of a segment is its serialized CanEvents (sorted by mono_time) after a small header,
+// so it can be mmapped as the stream's memory block when the route is opened again.
+struct CanCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t events;
+  uint64_t size;
+};
+static constexpr char CAN_CACHE_MAGIC[4] = {'C', 'A', 'N', 'C'};
+static constexpr uint32_t CAN_CACHE_VERSION = 1;
+
+static std::string canCachePath(const SegmentFile &files) {
+  const QString &log = files.rlog.isEmpty() ? files.qlog : files.rlog;
+  return log.isEmpty() ? "" : cacheFilePath(log.toStdString()) + ".can";
+}
+
+static void saveCanCache(const std::string &path, std::shared_ptr<char> data, size_t size, size_t events) {
+  CanCacheHeader header = {.version = CAN_CACHE_VERSION, .events = events, .size = size};
+  memcpy(header.magic, CAN_CACHE_MAGIC, sizeof(header.magic));
+  // QSaveFile writes to a unique temporary file and renames it on commit, a partially written cache
+  // is never mmapped, and two instances saving the same segment don't write into each other's file.
+  QSaveFile file(QString::fromStdString(path));
+  if (file.open(QIODevice::WriteOnly)) {
+    file.write((const char *)&header, sizeof(header));
+    file.write(data.get(), size);
+    file.commit();
+  }
+}
+
+// the events must lie inside the block and be sorted, the cache file may be corrupted.
+static bool validCanEvents(const char *data, size_t size, uint64_t events) {
+  const char *ptr = data, *end = data + size;
+  uint64_t prev_mono_time = 0;
+  for (uint64_t i = 0; i < events; ++i) {
+    if ((size_t)(end - ptr) < sizeof(CanEvent)) return false;
+    const CanEvent *e = (const CanEvent *)ptr;
+    if ((size_t)(end - ptr) < sizeof(CanEvent) + e->size || e->mono_time < prev_mono_time) return false;
+    prev_mono_time = e->mono_time;
+    ptr += sizeof(CanEvent) + sizeof(uint8_t) * e->size;
+  }
+  return ptr == end;
+}
 
 ReplayStream::ReplayStream(QObject *parent) : AbstractStream(parent) {
   unsetenv("ZMQ");
@@ -21,12 +73,54 @@ static bool event_filter(const Event *e, void *opaque) {
   return ((ReplayStream *)opaque)->eventFilter(e);
 }
 
+bool ReplayStream::loadCanCache(const std::string &path, MemoryBlock &block) {
+  int fd = path.empty() ? -1 : ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st = {};
+  void *base = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size > sizeof(CanCacheHeader)) {
+    base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  ::close(fd);
+  if (base == MAP_FAILED) return false;
+
+  const size_t len = st.st_size;
+  const auto *header = (const CanCacheHeader *)base;
+  if (memcmp(header->magic, CAN_CACHE_MAGIC, sizeof(header->magic)) != 0 || header->version != CAN_CACHE_VERSION ||
+      sizeof(CanCacheHeader) + header->size != len || header->events == 0 ||
+      !validCanEvents((const char *)base + sizeof(CanCacheHeader), header->size, header->events)) {
+    munmap(base, len);
+    return false;
+  }
+  block = {std::shared_ptr<char>((char *)base + sizeof(CanCacheHeader), [base, len](char *) { munmap(base, len); }),
+           header->size, header->events};
+  return true;
+}
+
 void ReplayStream::mergeSegments() {
+  if (!can_cache_loaded) {
+    // merge all cached segments of the route at once, replay still loads the segments it needs for playback.
+    can_cache_loaded = true;
+    std::vector<MemoryBlock> blocks;
+    for (const auto &[n, files] : replay->route()->segments()) {
+      if (MemoryBlock block; loadCanCache(canCachePath(files), block)) {
+        processed_segments.insert(n);
+        blocks.push_back(std::move(block));
+      }
+    }
+    mergeEvents(std::move(blocks));
+  }
+
   for (auto &[n, seg] : replay->segments()) {
     if (seg && seg->isLoaded() && !processed_segments.count(n)) {
       processed_segments.insert(n);
       const auto &events = seg->log->events;
-      mergeEvents(events.cbegin(), events.cend());
+      MemoryBlock block = serializeEvents(events.cbegin(), events.cend());
+      if (std::string path = canCachePath(replay->route()->segments().at(n)); block.events > 0 && !path.empty()) {
+        QtConcurrent::run(saveCanCache, path, block.data, block.size, block.events);
+      }
+      mergeEvents(std::vector<MemoryBlock>{block});
     }
   }
 }
@@ -28,8 +28,10 @@ public:
 
 private:
   void mergeSegments();
+  static bool loadCanCache(const std::string &path, MemoryBlock &block);
   std::unique_ptr<Replay> replay = nullptr;
   std::set<int> processed_segments;
+  bool can_cache_loaded = false;
   std::unique_ptr<OpenpilotPrefix> op_prefix;
 };
 
@@ -0,0 +1,279 @@
+#define CATCH_CONFIG_RUNNER
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <cmath>
+#include <deque>
+#include <random>
+
+#include <QApplication>
+
+#include "catch2/catch.hpp"
+#include "tools/replay/logreader.h"
+#include "tools/cabana/chart/chart.h"
+#include "tools/cabana/chart/chartswidget.h"
+#include "tools/cabana/dbc/dbcmanager.h"
+#include "tools/cabana/historylog.h"
+#include "tools/cabana/messageswidget.h"
+#include "tools/cabana/streams/abstractstream.h"
+#include "tools/cabana/tools/findsignal.h"
+
+// Benchmarks of the cabana hot paths. run with:
+//   tools/cabana/tests/bench_cabana [benchmark] --benchmark-samples 20
+// each benchmark name contains the number of events/frames/signals processed by one run,
+// divide it by the reported mean to get the throughput.
+
+// demo route, first segment
+const std::string TEST_RLOG_URL = "https://commadata2.blob.core.windows.net/commadata2/4cf7a6ad03080c90/2021-09-29--13-46-36/0/rlog.bz2";
+
+const MessageId BENCH_MSG_ID = {.source = 0, .address = 0x100};
+const QString BENCH_DBC = R"(
+BO_ 256 BENCH_MSG: 8 XXX
+  SG_ COUNTER : 0|8@1+ (1,0) [0|255] "" XXX
+  SG_ SPEED : 8|16@1+ (0.01,0) [0|655.35] "m/s" XXX
+  SG_ ANGLE : 39|12@0- (0.1,0) [-204.8|204.7] "deg" XXX
+  SG_ CHECKSUM : 56|8@1+ (1,0) [0|255] "" XXX
+)";
+
+class BenchStream : public DummyStream {
+public:
+  using DummyStream::DummyStream;
+  using AbstractStream::mergeEvents;
+  using AbstractStream::updateLastMsgsTo;
+};
+
+// Synthetic CAN traffic at the rate pandad publishes it: one can event every 10ms,
+// 100 messages on each of 3 buses at 1-100Hz, the third bus carries 64 byte CAN-FD frames.
+struct SyntheticLog {
+  SyntheticLog(int seconds) {
+    std::mt19937 rng(0);
+    uint64_t mono_time = 1e9;
+    for (int tick = 0; tick < seconds * 100; ++tick, mono_time += 1e7) {
+      std::vector<std::pair<uint32_t, uint8_t>> frames;
+      for (uint8_t bus = 0; bus < 3; ++bus) {
+        for (uint32_t i = 0; i < 100; ++i) {
+          if (tick % (1 + i % 10) == 0) frames.push_back({0x100 + i, bus});
+        }
+      }
+
+      capnp::MallocMessageBuilder msg;
+      auto event = msg.initRoot<cereal::Event>();
+      event.setLogMonoTime(mono_time);
+      auto can_data = event.initCan(frames.size());
+      for (int i = 0; i < frames.size(); ++i) {
+        auto [address, bus] = frames[i];
+        uint8_t dat[64] = {};
+        const int size = bus == 2 ? 64 : 8;
+        // a counter, two slowly changing values and a checksum, the rest is constant.
+        dat[0] = tick & 0xff;
+        const uint16_t speed = 1000 + 500 * std::sin(tick / 500.0 + address);
+        const int16_t angle = 200 * std::sin(tick / 300.0);
+        memcpy(&dat[1], &speed, sizeof(speed));
+        dat[4] = (angle >> 4) & 0xff;
+        dat[5] = (angle & 0xf) << 4;
+        dat[size - 1] = rng() & 0xff;
+        can_data[i].setSrc(bus);
+        can_data[i].setAddress(address);
+        can_data[i].setDat(kj::arrayPtr(dat, size));
+      }
+      frame_count += frames.size();
+      buffers.push_back(capnp::messageToFlatArray(msg));
+      const auto &words = buffers.back();
+      events.emplace_back(kj::ArrayPtr<const capnp::word>(words.begin(), words.size()));
+      event_ptrs.push_back(&events.back());
+    }
+  }
+
+  size_t frame_count = 0;
+  std::vector<kj::Array<capnp::word>> buffers;
+  std::deque<Event> events;
+  std::vector<Event *> event_ptrs;
+};
+
+static const SyntheticLog &syntheticLog() {
+  static SyntheticLog log(60);
+  return log;
+}
+
+static const LogReader *recordedLog() {
+  static LogReader *log = nullptr;
+  static bool loaded = false;
+  if (!loaded) {
+    loaded = true;
+    log = new LogReader();
+    if (!log->load(TEST_RLOG_URL, nullptr, {cereal::Event::Which::CAN}, true)) {
+      delete log;
+      log = nullptr;
+    }
+  }
+  return log;
+}
+
+static size_t canFrameCount(const std::vector<Event *> &events) {
+  size_t count = 0;
+  for (const Event *e : events) {
+    if (e->which == cereal::Event::Which::CAN) count += e->event.getCan().size();
+  }
+  return count;
+}
+
+// the global stream used by the models and charts, holds the merged synthetic log.
+static BenchStream *syntheticStream() {
+  static BenchStream *stream = nullptr;
+  if (!stream || can != stream) {
+    if (!dbc()->msg(BENCH_MSG_ID)) {
+      dbc()->open(SOURCE_ALL, "bench", BENCH_DBC);
+    }
+    stream = new BenchStream(qApp);
+    stream->start();
+    const auto &log = syntheticLog();
+    stream->mergeEvents(log.event_ptrs.cbegin(), log.event_ptrs.cend());
+    stream->updateLastMsgsTo(stream->totalSeconds());
+  }
+  return stream;
+}
+
+static void benchmarkMerge(const std::string &name, const std::vector<Event *> &events, int chunks) {
+  BENCHMARK_ADVANCED(name.c_str())(Catch::Benchmark::Chronometer meter) {
+    std::vector<std::unique_ptr<BenchStream>> streams(meter.runs());
+    for (auto &s : streams) s.reset(new BenchStream(qApp));
+    meter.measure([&](int run) {
+      // merge in chunks like the replay does for each loaded segment.
+      const size_t chunk_size = (events.size() + chunks - 1) / chunks;
+      for (size_t first = 0; first < events.size(); first += chunk_size) {
+        auto begin = events.cbegin() + first;
+        streams[run]->mergeEvents(begin, begin + std::min(chunk_size, events.size() - first));
+      }
+      return streams[run]->allEvents().size();
+    });
+  };
+}
+
+TEST_CASE("AbstractStream::mergeEvents", "[benchmark]") {
+  const auto &log = syntheticLog();
+  benchmarkMerge(QString("synthetic: %1 frames, 1 chunk").arg(log.frame_count).toStdString(), log.event_ptrs, 1);
+  benchmarkMerge(QString("synthetic: %1 frames, 60 chunks").arg(log.frame_count).toStdString(), log.event_ptrs, 60);
+
+  if (auto recorded = recordedLog()) {
+    benchmarkMerge(QString("recorded: %1 frames").arg(canFrameCount(recorded->events)).toStdString(), recorded->events, 1);
+  } else {
+    WARN("failed to load " << TEST_RLOG_URL);
+  }
+}
+
+TEST_CASE("AbstractStream::updateLastMsgsTo", "[benchmark]") {
+  auto stream = syntheticStream();
+  const double total_sec = stream->totalSeconds();
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<double> dist(0, total_sec);
+  BENCHMARK(QString("seek: %1 messages").arg(stream->eventsMap().size()).toStdString()) {
+    stream->updateLastMsgsTo(dist(rng));
+    return stream->last_msgs.size();
+  };
+}
+
+TEST_CASE("CanData::compute", "[benchmark]") {
+  auto stream = syntheticStream();
+  const auto &events = stream->allEvents();
+  BENCHMARK(QString("synthetic: %1 frames").arg(events.size()).toStdString()) {
+    std::unordered_map<MessageId, CanData> msgs;
+    for (const CanEvent *e : events) {
+      msgs[{.source = e->src, .address = e->address}].compute(e->dat, e->size, e->mono_time / 1e9, nullptr);
+    }
+    return msgs.size();
+  };
+}
+
+TEST_CASE("get_raw_value", "[benchmark]") {
+  auto stream = syntheticStream();
+  const auto &events = stream->events(BENCH_MSG_ID);
+  const auto &sigs = dbc()->msg(BENCH_MSG_ID)->getSignals();
+  BENCHMARK(QString("%1 frames x %2 signals").arg(events.size()).arg(sigs.size()).toStdString()) {
+    double sum = 0;
+    for (const CanEvent *e : events) {
+      for (const cabana::Signal *sig : sigs) {
+        sum += get_raw_value(e->dat, e->size, *sig);
+      }
+    }
+    return sum;
+  };
+}
+
+TEST_CASE("ChartView::updateSeries", "[benchmark]") {
+  auto stream = syntheticStream();
+  ChartsWidget charts;
+  ChartView chart({0, stream->totalSeconds()}, &charts);
+  const auto &sigs = dbc()->msg(BENCH_MSG_ID)->getSignals();
+  for (const cabana::Signal *sig : sigs) {
+    chart.addSignal(BENCH_MSG_ID, sig);
+  }
+  const size_t events = stream->events(BENCH_MSG_ID).size();
+  BENCHMARK(QString("%1 frames x %2 signals").arg(events).arg(sigs.size()).toStdString()) {
+    chart.updateSeries(nullptr, true);
+  };
+}
+
+TEST_CASE("FindSignalModel::search", "[benchmark]") {
+  auto stream = syntheticStream();
+  FindSignalModel model(nullptr);
+  // all signals of 8 to 16 bits in the messages on bus 0, like FindSignalDlg::setInitialSignals.
+  for (auto it = stream->last_msgs.cbegin(); it != stream->last_msgs.cend(); ++it) {
+    if (it.key().source != 0) continue;
+
+    const CanEvent *e = stream->events(it.key()).front();
+    const int total_size = it.value().dat.size() * 8;
+    for (int size = 8; size <= 16; ++size) {
+      for (int start = 0; start <= total_size - size; ++start) {
+        FindSignalModel::SearchSignal s{.id = it.key(), .mono_time = e->mono_time};
+        s.sig.is_little_endian = true;
+        s.sig.factor = 1;
+        updateSigSizeParamsFromRange(s.sig, start, size);
+        s.value = get_raw_value(e->dat, e->size, s.sig);
+        model.initial_signals.push_back(s);
+      }
+    }
+  }
+
+  BENCHMARK(QString("%1 signals, 2 steps").arg(model.initial_signals.size()).toStdString()) {
+    model.histories.clear();
+    model.filtered_signals.clear();
+    model.search([](double v) { return v > 10; });
+    model.search([](double v) { return v > 100; });
+    return model.filtered_signals.size();
+  };
+}
+
+// HistoryLogModel keeps an index into the events of the message instead of copying the rows,
+// the index is built in updateFilteredIndex and the visible rows are materialized in data().
+TEST_CASE("HistoryLogModel", "[benchmark]") {
+  auto stream = syntheticStream();
+  HistoryLogModel model(nullptr);
+  model.setMessage(BENCH_MSG_ID);
+  const size_t events = stream->events(BENCH_MSG_ID).size();
+
+  BENCHMARK(QString("index %1 events").arg(events).toStdString()) {
+    model.setFilter(-1, "", nullptr);
+    model.refresh();
+    return model.rowCount();
+  };
+  BENCHMARK(QString("filter %1 events").arg(events).toStdString()) {
+    model.setFilter(1, "10", [](double l, double r) { return l > r; });
+    model.refresh();
+    return model.rowCount();
+  };
+  BENCHMARK("data: 100 rows") {
+    size_t size = 0;
+    for (int row = 0; row < std::min(100, model.rowCount()); ++row) {
+      for (int col = 0; col < model.columnCount(); ++col) {
+        size += model.data(model.index(row, col)).toString().size();
+      }
+    }
+    return size;
+  };
+}
+
+int main(int argc, char **argv) {
+  // the charts need a QApplication, render them offscreen
+  qputenv("QT_QPA_PLATFORM", "offscreen");
+  QApplication app(argc, argv);
+  const int res = Catch::Session().run(argc, argv);
+  return (res < 0xff ? res : 0xff);
+}
@@ -1,9 +1,17 @@
 
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <fstream>
+#include <random>
+
+#include <QDir>
+
 #include "opendbc/can/common.h"
 #undef INFO
 #include "catch2/catch.hpp"
 #include "tools/replay/logreader.h"
 #include "tools/cabana/dbc/dbcmanager.h"
+#include "tools/cabana/export.h"
+#include "tools/cabana/messageswidget.h"
 #include "tools/cabana/streams/abstractstream.h"
 
 // demo route, first segment
@@ -124,3 +132,215 @@ CM_ SG_ 160 signal_2 "multiple line comment
   REQUIRE(msg->sigs[1]->start_bit == 12);
   REQUIRE(msg->sigs[1]->size == 1);
 }
+
+TEST_CASE("CanData::compute") {
+  const uint8_t dat_1[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07};
+  const uint8_t dat_2[] = {0x00, 0x81, 0x02, 0x03, 0x04, 0x05, 0x06, 0x0f};
+  const std::vector<uint8_t> mask = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff};
+
+  CanData data;
+  data.compute(dat_1, std::size(dat_1), 0, nullptr);
+  data.compute(dat_2, std::size(dat_2), 1, nullptr);
+  REQUIRE(data.count == 2);
+  REQUIRE(data.bit_change_counts[1][7] == 1);
+  REQUIRE(data.bit_change_counts[7][3] == 1);
+  REQUIRE(data.last_change_t[1] == 1);
+  REQUIRE(data.last_change_t[0] == 0);
+  REQUIRE(data.periodic_change_counter[1] == 1);
+
+  // masked bytes are not tracked
+  data.compute(dat_1, std::size(dat_1), 2, &mask);
+  REQUIRE(data.bit_change_counts[1][7] == 2);
+  REQUIRE(data.bit_change_counts[7][3] == 1);
+  REQUIRE(data.last_change_t[7] == 1);
+  REQUIRE(data.colors().size() == std::size(dat_1));
+
+  // the frequency is counted from the first event of the stream
+  CanData late;
+  late.compute(dat_1, std::size(dat_1), 100, nullptr, 0, 98);
+  late.compute(dat_2, std::size(dat_2), 102, nullptr, 0, 98);
+  REQUIRE(late.freq == 0.5);
+}
+
+TEST_CASE("CanData::compute throughput", "[.benchmark]") {
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> dist(0, 255);
+  for (int size : {8, 64}) {
+    std::vector<std::vector<uint8_t>> frames(1000, std::vector<uint8_t>(size));
+    for (int i = 0; i < frames.size(); ++i) {
+      for (int j = 0; j < size; ++j) {
+        // counters and checksums change every frame, the rest rarely changes.
+        frames[i][j] = j == 0 ? i & 0xff : (j == size - 1 ? dist(rng) : (i / 100) & 0xff);
+      }
+    }
+    CanData data;
+    double sec = 0;
+    BENCHMARK(QString("%1 frames of %2 bytes").arg(frames.size()).arg(size).toStdString()) {
+      for (const auto &f : frames) {
+        data.compute(f.data(), f.size(), sec += 0.01, nullptr);
+      }
+      return data.count;
+    };
+  }
+}
+
+TEST_CASE("exportSignals") {
+  REQUIRE(dbc()->open({0}, QString("%1/%2.dbc").arg(OPENDBC_FILE_PATH, "toyota_new_mc_pt_generated")));
+  const MessageId id = {.source = 0, .address = 0x25};
+  const auto msg = dbc()->msg(id);
+  REQUIRE(msg != nullptr);
+  const cabana::Signal *sig = msg->sig("STEER_ANGLE");
+  REQUIRE(sig != nullptr);
+
+  const QString fn = QDir::temp().filePath("test_cabana_export.bin");
+  REQUIRE(exportSignals({TEST_RLOG_URL}, {"STEER_ANGLE_SENSOR.STEER_ANGLE"}, 100, fn));
+
+  std::ifstream fs(fn.toStdString(), std::ios::binary);
+  char magic[8] = {};
+  uint32_t columns = 0;
+  uint64_t rows = 0;
+  fs.read(magic, sizeof(magic));
+  fs.read((char *)&columns, sizeof(columns));
+  fs.read((char *)&rows, sizeof(rows));
+  REQUIRE(std::string(magic) == "CABCOL1");
+  REQUIRE(columns == 2);
+  for (const std::string expected : {"time", "0:STEER_ANGLE_SENSOR.STEER_ANGLE"}) {
+    uint16_t size = 0;
+    fs.read((char *)&size, sizeof(size));
+    std::string name(size, '\0');
+    fs.read(name.data(), size);
+    REQUIRE(name == expected);
+  }
+  std::vector<double> times(rows), values(rows);
+  fs.read((char *)times.data(), rows * sizeof(double));
+  fs.read((char *)values.data(), rows * sizeof(double));
+  REQUIRE(fs);
+  QFile::remove(fn);
+
+  // each row holds the latest value at its time
+  LogReader log;
+  REQUIRE(log.load(TEST_RLOG_URL, nullptr, {}, true));
+  std::vector<std::pair<uint64_t, double>> samples;
+  for (auto e : log.events) {
+    if (e->which != cereal::Event::Which::CAN) continue;
+    for (const auto &c : e->event.getCan()) {
+      if (c.getSrc() != id.source || c.getAddress() != id.address) continue;
+
+      double value = 0;
+      const auto dat = c.getDat();
+      if (sig->getValue((const uint8_t *)dat.begin(), dat.size(), &value)) {
+        samples.push_back({e->mono_time, value});
+      }
+    }
+  }
+  REQUIRE(samples.size() > 0);
+  REQUIRE(rows == (samples.back().first - samples.front().first) / 10000000ULL + 1);
+  size_t cursor = 0;
+  for (uint64_t row = 0; row < rows; ++row) {
+    const uint64_t ts = samples.front().first + row * 10000000ULL;
+    while (cursor < samples.size() && samples[cursor].first <= ts) ++cursor;
+    REQUIRE(times[row] == row * 10000000ULL / 1e9);
+    REQUIRE(values[row] == samples[cursor - 1].second);
+  }
+  dbc()->close({0});
+}
+
+class TestStream : public DummyStream {
+public:
+  using DummyStream::DummyStream;
+  using AbstractStream::dropEvents;
+
+  // merges count 8 byte events, one every 10ms from mono_time.
+  void merge(uint32_t address, uint64_t mono_time, int count) {
+    const size_t event_size = sizeof(CanEvent) + 8;
+    auto data = std::make_unique<char[]>(event_size * count);
+    for (int i = 0; i < count; ++i) {
+      CanEvent *e = (CanEvent *)&data[i * event_size];
+      e->src = 0;
+      e->address = address;
+      e->mono_time = mono_time + i * 10000000ULL;
+      e->size = 8;
+      memset(e->dat, i, 8);
+    }
+    mergeEvents(std::move(data), event_size * count, count);
+  }
+};
+
+TEST_CASE("AbstractStream::dropEvents") {
+  TestStream stream(QCoreApplication::instance());
+  stream.merge(0x100, 1000000000ULL, 10);
+  stream.merge(0x100, 3000000000ULL, 10);
+  // inserted before the newer events
+  stream.merge(0x100, 2000000000ULL, 10);
+  REQUIRE(stream.allEvents().size() == 30);
+
+  const size_t drop_count = stream.dropCount();
+  REQUIRE(stream.dropEvents(2500000000ULL, SIZE_MAX) == 10);
+  REQUIRE(stream.dropCount() == drop_count + 1);
+  REQUIRE(stream.allEvents().size() == 20);
+  REQUIRE(stream.events({.source = 0, .address = 0x100}).size() == 20);
+  REQUIRE(stream.firstEventMonoTime() == 2000000000ULL);
+
+  // the last merged block is always kept, but its events before the newest dropped event are removed
+  REQUIRE(stream.dropEvents(4000000000ULL, SIZE_MAX) == 20);
+  REQUIRE(stream.allEvents().empty());
+  REQUIRE(stream.events({.source = 0, .address = 0x100}).empty());
+}
+
+static void fillMessages(QHash<MessageId, CanData> &msgs, int n, std::mt19937 &rng) {
+  msgs.clear();
+  for (int i = 0; i < n; ++i) {
+    auto &m = msgs[{.source = uint8_t(i % 3), .address = uint32_t(i)}];
+    m.dat = QByteArray(8, char(i));
+    m.freq = rng() % 100;
+    m.count = rng() % 1000;
+  }
+}
+
+TEST_CASE("MessageListModel::msgsReceived") {
+  auto stream = new DummyStream(QCoreApplication::instance());
+  stream->start();
+  std::mt19937 rng(0);
+  fillMessages(stream->last_msgs, 100, rng);
+
+  MessageListModel model(nullptr);
+  model.sort(MessageListModel::Column::FREQ, Qt::DescendingOrder);
+  REQUIRE(model.rowCount() == 100);
+
+  // the sort order is repaired after the frequencies changed
+  for (auto &m : stream->last_msgs) {
+    m.freq = rng() % 100;
+  }
+  model.msgsReceived(&stream->last_msgs, false);
+  auto freq_desc = [&](auto &l, auto &r) { return can->lastMessage(l).freq > can->lastMessage(r).freq; };
+  REQUIRE(std::is_sorted(model.msgs.cbegin(), model.msgs.cend(), freq_desc));
+
+  // dynamic filters are applied to the updated messages
+  model.setFilterStrings({{MessageListModel::Column::COUNT, "0-499"}});
+  for (auto &m : stream->last_msgs) {
+    m.count = 500;
+  }
+  stream->last_msgs.begin()->count = 10;
+  model.msgsReceived(&stream->last_msgs, false);
+  REQUIRE(model.rowCount() == 1);
+}
+
+TEST_CASE("MessageListModel update", "[.benchmark]") {
+  auto stream = new DummyStream(QCoreApplication::instance());
+  stream->start();
+  std::mt19937 rng(0);
+  for (int n : {100, 500, 2000}) {
+    fillMessages(stream->last_msgs, n, rng);
+    MessageListModel model(nullptr);
+    model.sort(MessageListModel::Column::FREQ, Qt::DescendingOrder);
+    BENCHMARK(QString("%1 messages sorted by frequency").arg(n).toStdString()) {
+      // a few messages change their frequency every update
+      for (auto &m : stream->last_msgs) {
+        m.count += 1;
+        m.freq = std::max(0.0, m.freq + int(rng() % 3) - 1);
+      }
+      model.msgsReceived(&stream->last_msgs, false);
+      return model.rowCount();
+    };
+  }
+}
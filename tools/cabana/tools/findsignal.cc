@@ -18,50 +18,158 @@ QVariant FindSignalModel::headerData(int section, Qt::Orientation orientation, i
 
 QVariant FindSignalModel::data(const QModelIndex &index, int role) const {
   if (role == Qt::DisplayRole) {
-    const auto &s = filtered_signals[index.row()];
+    const int idx = filtered_signals[index.row()];
+    const auto &s = initial_signals[idx];
     switch (index.column()) {
       case 0: return s.id.toString();
       case 1: return QString("%1, %2").arg(s.sig.start_bit).arg(s.sig.size);
-      case 2: return s.values.join(" ");
+      case 2: {
+        QStringList values;
+        for (const auto &h : histories) {
+          const int i = h.rank(idx);
+          values += QString("(%1, %2)").arg(h.mono_times[i] / 1e9 - can->routeStartTime(), 0, 'f', 2).arg(h.values[i]);
+        }
+        return values.join(" ");
+      }
     }
   }
   return {};
 }
 
+namespace {
+
+// Extracts a signal from one 64-bit load of the frame instead of walking its bytes in get_raw_value.
+struct BitExtractor {
+  BitExtractor(const cabana::Signal *sig) : sig(sig) {
+    shift = sig->is_little_endian ? sig->lsb : (7 - sig->lsb / 8) * 8 + sig->lsb % 8;
+    mask = sig->size >= 64 ? ~0ULL : (1ULL << sig->size) - 1;
+    max_byte = std::max(sig->msb, sig->lsb) / 8;
+  }
+
+  inline double value(const CanEvent *e, uint64_t le_word, uint64_t be_word) const {
+    if (max_byte >= std::min<int>(e->size, 8)) {
+      return get_raw_value(e->dat, e->size, *sig);
+    }
+    int64_t val = ((sig->is_little_endian ? le_word : be_word) >> shift) & mask;
+    if (sig->is_signed) {
+      val -= ((val >> (sig->size - 1)) & 0x1) ? (1ULL << sig->size) : 0;
+    }
+    return val * sig->factor + sig->offset;
+  }
+
+  const cabana::Signal *sig;
+  int shift;
+  int max_byte;
+  uint64_t mask;
+};
+
+}  // namespace
+
 void FindSignalModel::search(std::function<bool(double)> cmp) {
   beginResetModel();
 
-  std::mutex lock;
-  const auto prev_sigs = !histories.isEmpty() ? histories.back() : initial_signals;
-  filtered_signals.clear();
-  filtered_signals.reserve(prev_sigs.size());
-  QtConcurrent::blockingMap(prev_sigs, [&](auto &s) {
-    const auto &events = can->events(s.id);
-    auto first = std::upper_bound(events.cbegin(), events.cend(), s.mono_time, [](uint64_t ts, auto &e) { return ts < e->mono_time; });
+  struct Match {
+    int idx;
+    uint64_t mono_time;
+    double value;
+  };
+  struct MessageCandidates {
+    int begin, end;
+    std::vector<Match> matches;
+  };
+
+  // initial_signals are generated message by message, sweep the events of each message once.
+  std::vector<MessageCandidates> messages;
+  for (int i = 0; i < initial_signals.size(); ++i) {
+    if (i == 0 || initial_signals[i].id != initial_signals[i - 1].id) {
+      messages.push_back({.begin = i});
+    }
+    messages.back().end = i + 1;
+  }
+
+  const SearchResult *prev = !histories.isEmpty() ? &histories.back() : nullptr;
+  QtConcurrent::blockingMap(messages, [&](MessageCandidates &m) {
+    struct Candidate {
+      int idx;
+      uint64_t mono_time;
+      BitExtractor extractor;
+    };
+    std::vector<Candidate> pending;
+    uint64_t first_time = std::numeric_limits<uint64_t>::max();
+    for (int i = m.begin; i < m.end; ++i) {
+      if (prev && !prev->contains(i)) continue;
+
+      uint64_t mono_time = prev ? prev->mono_times[prev->rank(i)] : initial_signals[i].mono_time;
+      pending.push_back({.idx = i, .mono_time = mono_time, .extractor = BitExtractor(&initial_signals[i].sig)});
+      first_time = std::min(first_time, mono_time);
+    }
+    if (pending.empty()) return;
+
+    const auto &events = can->events(initial_signals[m.begin].id);
+    auto first = std::upper_bound(events.cbegin(), events.cend(), first_time, [](uint64_t ts, auto &e) { return ts < e->mono_time; });
     auto last = events.cend();
     if (last_time < std::numeric_limits<uint64_t>::max()) {
       last = std::upper_bound(events.cbegin(), events.cend(), last_time, [](uint64_t ts, auto &e) { return ts < e->mono_time; });
     }
 
-    auto it = std::find_if(first, last, [&](const CanEvent *e) { return cmp(get_raw_value(e->dat, e->size, s.sig)); });
-    if (it != last) {
-      auto values = s.values;
-      values += QString("(%1, %2)").arg((*it)->mono_time / 1e9 - can->routeStartTime(), 0, 'f', 2).arg(get_raw_value((*it)->dat, (*it)->size, s.sig));
-      std::lock_guard lk(lock);
-      filtered_signals.push_back({.id = s.id, .mono_time = (*it)->mono_time, .sig = s.sig, .values = values});
+    for (auto it = first; it != last && !pending.empty(); ++it) {
+      const CanEvent *e = *it;
+      uint64_t le_word = 0;
+      memcpy(&le_word, e->dat, std::min<int>(e->size, 8));
+      const uint64_t be_word = __builtin_bswap64(le_word);
+      for (int i = 0; i < pending.size(); /**/) {
+        auto &c = pending[i];
+        double value = 0;
+        if (e->mono_time > c.mono_time && cmp(value = c.extractor.value(e, le_word, be_word))) {
+          m.matches.push_back({.idx = c.idx, .mono_time = e->mono_time, .value = value});
+          c = pending.back();
+          pending.pop_back();
+        } else {
+          ++i;
+        }
+      }
     }
+    std::sort(m.matches.begin(), m.matches.end(), [](auto &l, auto &r) { return l.idx < r.idx; });
   });
-  histories.push_back(filtered_signals);
+
+  SearchResult result;
+  result.bits.resize((initial_signals.size() + 63) / 64);
+  for (const auto &m : messages) {
+    for (const auto &match : m.matches) {
+      result.bits[match.idx / 64] |= 1ULL << (match.idx % 64);
+      result.mono_times.push_back(match.mono_time);
+      result.values.push_back(match.value);
+    }
+  }
+  result.word_rank.resize(result.bits.size());
+  for (int i = 0, n = 0; i < result.bits.size(); ++i) {
+    result.word_rank[i] = n;
+    n += __builtin_popcountll(result.bits[i]);
+  }
+  histories.push_back(std::move(result));
+  updateFilteredSignals();
 
   endResetModel();
 }
 
+void FindSignalModel::updateFilteredSignals() {
+  filtered_signals.clear();
+  if (!histories.isEmpty()) {
+    const auto &bits = histories.back().bits;
+    filtered_signals.reserve(histories.back().values.size());
+    for (int i = 0; i < bits.size(); ++i) {
+      for (uint64_t w = bits[i]; w != 0; w &= w - 1) {
+        filtered_signals.push_back(i * 64 + __builtin_ctzll(w));
+      }
+    }
+  }
+}
+
 void FindSignalModel::undo() {
   if (!histories.isEmpty()) {
     beginResetModel();
     histories.pop_back();
-    filtered_signals.clear();
-    if (!histories.isEmpty()) filtered_signals = histories.back();
+    updateFilteredSignals();
     endResetModel();
   }
 }
@@ -163,7 +271,7 @@ FindSignalDlg::FindSignalDlg(QWidget *parent) : QDialog(parent, Qt::WindowFlags(
   QObject::connect(reset_btn, &QPushButton::clicked, model, &FindSignalModel::reset);
   QObject::connect(view, &QTableView::customContextMenuRequested, this, &FindSignalDlg::customMenuRequested);
   QObject::connect(view, &QTableView::doubleClicked, [this](const QModelIndex &index) {
-    if (index.isValid()) emit openMessage(model->filtered_signals[index.row()].id);
+    if (index.isValid()) emit openMessage(model->signalAt(index.row()).id);
   });
   QObject::connect(compare_cb, qOverload<int>(&QComboBox::currentIndexChanged), [=](int index) {
     to_label->setVisible(index == compare_cb->count() - 1);
@@ -257,7 +365,7 @@ void FindSignalDlg::customMenuRequested(const QPoint &pos) {
     QMenu menu(this);
     menu.addAction(tr("Create Signal"));
     if (menu.exec(view->mapToGlobal(pos))) {
-      auto &s = model->filtered_signals[index.row()];
+      auto s = model->signalAt(index.row());
       auto msg = dbc()->msg(s.id);
       if (!msg) {
         UndoStack::push(new EditMsgCommand(s.id, dbc()->newMsgName(s.id), can->lastMessage(s.id).dat.size(), ""));
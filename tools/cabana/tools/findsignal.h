@@ -15,22 +15,37 @@ public:
     uint64_t mono_time = 0;
     cabana::Signal sig = {};
     double value = 0.;
-    QStringList values;
+  };
+
+  // Candidates that still match after a search step, stored as a bitset over initial_signals.
+  // mono_times and values hold the matched event of each set bit, in index order.
+  struct SearchResult {
+    inline bool contains(int idx) const { return (bits[idx / 64] >> (idx % 64)) & 1; }
+    inline int rank(int idx) const { return word_rank[idx / 64] + __builtin_popcountll(bits[idx / 64] & ((1ULL << (idx % 64)) - 1)); }
+
+    std::vector<uint64_t> bits;
+    std::vector<uint32_t> word_rank;
+    std::vector<uint64_t> mono_times;
+    std::vector<double> values;
   };
 
   FindSignalModel(QObject *parent) : QAbstractTableModel(parent) {}
   QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
   QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
   int columnCount(const QModelIndex &parent = QModelIndex()) const override { return 3; }
-  int rowCount(const QModelIndex &parent = QModelIndex()) const override { return std::min(filtered_signals.size(), 300); }
+  int rowCount(const QModelIndex &parent = QModelIndex()) const override { return std::min<int>(filtered_signals.size(), 300); }
+  inline const SearchSignal &signalAt(int row) const { return initial_signals[filtered_signals[row]]; }
   void search(std::function<bool(double)> cmp);
   void reset();
   void undo();
 
-  QList<SearchSignal> filtered_signals;
-  QList<SearchSignal> initial_signals;
-  QList<QList<SearchSignal>> histories;
+  std::vector<int> filtered_signals;  // indexes into initial_signals
+  std::vector<SearchSignal> initial_signals;
+  QList<SearchResult> histories;
   uint64_t last_time = std::numeric_limits<uint64_t>::max();
+
+private:
+  void updateFilteredSignals();
 };
 
 class FindSignalDlg : public QDialog {
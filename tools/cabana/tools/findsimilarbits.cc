@@ -7,6 +7,7 @@
 #include <QLabel>
 #include <QPushButton>
 #include <QRadioButton>
+#include <QtConcurrent>
 
 #include "tools/cabana/dbc/dbcmanager.h"
 #include "tools/cabana/streams/abstractstream.h"
@@ -83,6 +84,7 @@ FindSimilarBitsDlg::FindSimilarBitsDlg(QWidget *parent) : QDialog(parent, Qt::Wi
 
   setMinimumSize({700, 500});
   QObject::connect(search_btn, &QPushButton::clicked, this, &FindSimilarBitsDlg::find);
+  QObject::connect(can, &AbstractStream::eventsMerged, this, [this]() { bit_planes.clear(); });
   QObject::connect(table, &QTableWidget::doubleClicked, [this](const QModelIndex &index) {
     if (index.isValid()) {
       MessageId msg_id = {.source = (uint8_t)find_bus_combo->currentData().toUInt(), .address = table->item(index.row(), 0)->text().toUInt(0, 16)};
@@ -112,44 +114,129 @@ void FindSimilarBitsDlg::find() {
   search_btn->setEnabled(true);
 }
 
-QList<FindSimilarBitsDlg::mismatched_struct> FindSimilarBitsDlg::calcBits(uint8_t bus, uint32_t selected_address, int byte_idx,
-                                                                          int bit_idx, uint8_t find_bus, bool equal, int min_msgs_cnt) {
-  QHash<uint32_t, QVector<uint32_t>> mismatches;
-  QHash<uint32_t, uint32_t> msg_count;
-  const auto &events = can->allEvents();
-  int bit_to_find = -1;
+// byte r of x is row r, returns the columns: bit r of byte c is bit c of row r.
+static inline uint64_t transpose8x8(uint64_t x) {
+  uint64_t t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+  x ^= t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+  x ^= t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+  return x ^ t ^ (t << 28);
+}
+
+void FindSimilarBitsDlg::buildBitPlanes(const CanEventList &events, BitPlanes &p) {
+  p.events = events.size();
+  p.size = 0;
   for (const CanEvent *e : events) {
-    if (e->src == bus) {
-      if (e->address == selected_address && e->size > byte_idx) {
-        bit_to_find = ((e->dat[byte_idx] >> (7 - bit_idx)) & 1) != 0;
-      }
+    p.size = std::max<int>(p.size, std::min<int>(e->size, 64));
+  }
+  const size_t blocks = (events.size() + 63) / 64;
+  p.planes.assign(blocks * p.size * 8, 0);
+  p.byte_valid.assign(blocks * p.size, 0);
+
+  for (size_t block = 0; block < blocks; ++block) {
+    const size_t first = block * 64, n = std::min<size_t>(64, events.size() - first);
+    uint64_t *planes = &p.planes[block * p.size * 8];
+    uint64_t *byte_valid = &p.byte_valid[block * p.size];
+
+    // byte i is valid for the events longer than i
+    std::array<uint64_t, 65> by_size = {};
+    for (size_t k = 0; k < n; ++k) {
+      by_size[std::min<int>(events[first + k]->size, p.size)] |= 1ULL << k;
+    }
+    uint64_t valid = 0;
+    for (int i = p.size - 1; i >= 0; --i) {
+      valid |= by_size[i + 1];
+      byte_valid[i] = valid;
     }
-    if (e->src == find_bus) {
-      ++msg_count[e->address];
-      if (bit_to_find == -1) continue;
 
-      auto &mismatched = mismatches[e->address];
-      if (mismatched.size() < e->size * 8) {
-        mismatched.resize(e->size * 8);
+    // gather each byte of 8 events into a word and transpose it, the columns are 8 bits of the planes.
+    for (size_t k0 = 0; k0 < n; k0 += 8) {
+      std::array<uint64_t, 64> rows = {};
+      for (size_t r = 0; r < 8 && k0 + r < n; ++r) {
+        const CanEvent *e = events[first + k0 + r];
+        for (int i = 0; i < std::min<int>(e->size, p.size); ++i) {
+          rows[i] |= (uint64_t)e->dat[i] << (r * 8);
+        }
       }
-      for (int i = 0; i < e->size; ++i) {
+      for (int i = 0; i < p.size; ++i) {
+        const uint64_t cols = transpose8x8(rows[i]);
         for (int j = 0; j < 8; ++j) {
-          int bit = ((e->dat[i] >> (7 - j)) & 1) != 0;
-          mismatched[i * 8 + j] += equal ? (bit != bit_to_find) : (bit == bit_to_find);
+          planes[i * 8 + j] |= ((cols >> ((7 - j) * 8)) & 0xff) << k0;
         }
       }
     }
   }
+}
 
-  QList<mismatched_struct> result;
-  result.reserve(mismatches.size());
-  for (auto it = mismatches.begin(); it != mismatches.end(); ++it) {
-    if (auto cnt = msg_count[it.key()]; cnt > min_msgs_cnt) {
-      auto &mismatched = it.value();
-      for (int i = 0; i < mismatched.size(); ++i) {
-        if (float perc = (mismatched[i] / (double)cnt) * 100; perc < 50) {
-          result.push_back({it.key(), (uint32_t)i / 8, (uint32_t)i % 8, mismatched[i], cnt, perc});
+QList<FindSimilarBitsDlg::mismatched_struct> FindSimilarBitsDlg::calcBits(uint8_t bus, uint32_t selected_address, int byte_idx,
+                                                                          int bit_idx, uint8_t find_bus, bool equal, int min_msgs_cnt) {
+  struct MessageBits {
+    uint32_t address;
+    const CanEventList *events;
+    BitPlanes *planes;
+    std::vector<uint32_t> mismatches;
+  };
+  std::vector<MessageBits> messages;
+  for (const auto &[id, events] : can->eventsMap()) {
+    if (id.source == find_bus && events.size() > min_msgs_cnt) {
+      messages.push_back({.address = id.address, .events = &events, .planes = &bit_planes[id]});
+    }
+  }
+
+  // The events of each message form its time grid. Its bits are transposed into 64-event bit planes once,
+  // the source bit is sampled onto the same grid, and mismatches are counted with XOR + popcount.
+  const auto &src_events = can->events({.source = bus, .address = selected_address});
+  QtConcurrent::blockingMap(messages, [&](MessageBits &m) {
+    const auto &events = *m.events;
+    if (m.planes->events != events.size()) {
+      buildBitPlanes(events, *m.planes);
+    }
+    const BitPlanes &p = *m.planes;
+    m.mismatches.assign(p.size * 8, 0);
+    auto src_it = src_events.cbegin();
+    int bit_to_find = -1, max_size = 0;
+
+    for (size_t block = 0; block * 64 < events.size(); ++block) {
+      const size_t first = block * 64, n = std::min<size_t>(64, events.size() - first);
+      uint64_t src_bits = 0, src_valid = 0;
+      for (size_t k = 0; k < n; ++k) {
+        const CanEvent *e = events[first + k];
+        for (; src_it != src_events.cend() && (*src_it)->mono_time <= e->mono_time; ++src_it) {
+          if ((*src_it)->size > byte_idx) {
+            bit_to_find = ((*src_it)->dat[byte_idx] >> (7 - bit_idx)) & 1;
+          }
         }
+        if (bit_to_find == -1) continue;
+
+        src_valid |= 1ULL << k;
+        src_bits |= (uint64_t)bit_to_find << k;
+      }
+      if (src_valid == 0) continue;
+
+      const uint64_t *planes = &p.planes[block * p.size * 8];
+      const uint64_t *byte_valid = &p.byte_valid[block * p.size];
+      for (int i = 0; i < p.size; ++i) {
+        const uint64_t valid = src_valid & byte_valid[i];
+        if (valid == 0) continue;
+
+        max_size = std::max(max_size, i + 1);
+        for (int j = 0; j < 8; ++j) {
+          const uint64_t diff = planes[i * 8 + j] ^ src_bits;
+          m.mismatches[i * 8 + j] += __builtin_popcountll((equal ? diff : ~diff) & valid);
+        }
+      }
+    }
+    // only the bytes that were compared
+    m.mismatches.resize(max_size * 8);
+  });
+
+  QList<mismatched_struct> result;
+  for (const auto &m : messages) {
+    const uint32_t cnt = m.events->size();
+    for (int i = 0; i < m.mismatches.size(); ++i) {
+      if (float perc = (m.mismatches[i] / (double)cnt) * 100; perc < 50) {
+        result.push_back({m.address, (uint32_t)i / 8, (uint32_t)i % 8, m.mismatches[i], cnt, perc});
       }
     }
   }
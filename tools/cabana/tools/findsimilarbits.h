@@ -1,5 +1,8 @@
 #pragma once
 
+#include <unordered_map>
+#include <vector>
+
 #include <QComboBox>
 #include <QDialog>
 #include <QLineEdit>
@@ -7,6 +10,7 @@
 #include <QTableWidget>
 
 #include "tools/cabana/dbc/dbcmanager.h"
+#include "tools/cabana/streams/abstractstream.h"
 
 class FindSimilarBitsDlg : public QDialog {
   Q_OBJECT
@@ -22,6 +26,14 @@ private:
     uint32_t address, byte_idx, bit_idx, mismatches, total;
     float perc;
   };
+  // the bits of a message transposed into planes of 64 events, independent of the query.
+  struct BitPlanes {
+    size_t events = 0;
+    int size = 0;  // the largest event in bytes
+    std::vector<uint64_t> planes;  // size * 8 per block of 64 events, bit k is event k of the block
+    std::vector<uint64_t> byte_valid;  // size per block, the events that have the byte
+  };
+  static void buildBitPlanes(const CanEventList &events, BitPlanes &p);
   QList<mismatched_struct> calcBits(uint8_t bus, uint32_t selected_address, int byte_idx, int bit_idx, uint8_t find_bus,
                                     bool equal, int min_msgs_cnt);
   void find();
@@ -31,4 +43,5 @@ private:
   QSpinBox *byte_idx_sb, *bit_idx_sb;
   QPushButton *search_btn;
   QLineEdit *min_msgs;
+  std::unordered_map<MessageId, BitPlanes> bit_planes;  // cleared when events are merged
 };
@@ -12,6 +12,7 @@
 
 const int MIN_VIDEO_HEIGHT = 100;
 const int THUMBNAIL_MARGIN = 3;
+const int THUMBNAIL_CACHE_SIZE = 100;
 
 static const QColor timeline_colors[] = {
   [(int)TimelineType::None] = QColor(111, 143, 175),
@@ -150,6 +151,8 @@ void VideoWidget::updatePlayBtnState() {
 // Slider
 Slider::Slider(QWidget *parent) : thumbnail_label(parent), QSlider(Qt::Horizontal, parent) {
   setMouseTracking(true);
+  thumbnail_cache.setMaxCost(THUMBNAIL_CACHE_SIZE);
+  decode_pool.setMaxThreadCount(2);
   auto timer = new QTimer(this);
   timer->callOnTimeout([this]() {
     timeline = can->getTimeline();
@@ -169,39 +172,70 @@ Slider::~Slider() {
   if (qlog_future) {
     qlog_future->waitForFinished();
   }
+  decode_pool.clear();
+  decode_pool.waitForDone();
 }
 
 void Slider::parseQLog() {
+  // parse segments in parallel, newest first.
   const auto &segments = can->route()->segments();
-  for (auto it = segments.rbegin(); it != segments.rend() && !abort_parse_qlog; ++it) {
-    LogReader log;
-    std::string qlog = it->second.qlog.toStdString();
-    if (!qlog.empty() && log.load(qlog, &abort_parse_qlog, {cereal::Event::Which::THUMBNAIL, cereal::Event::Which::CONTROLS_STATE}, true, 0, 3)) {
-      if (it == segments.rbegin() && !log.events.empty()) {
-        double max_time = (*(log.events.rbegin()))->mono_time / 1e9 - can->routeStartTime();
-        emit updateMaximumTime(max_time);
-      }
-      for (auto ev = log.events.cbegin(); ev != log.events.cend() && !abort_parse_qlog; ++ev) {
-        if ((*ev)->which == cereal::Event::Which::THUMBNAIL) {
-          auto thumb = (*ev)->event.getThumbnail();
-          auto data = thumb.getThumbnail();
-          if (QPixmap pm; pm.loadFromData(data.begin(), data.size(), "jpeg")) {
-            pm = pm.scaledToHeight(MIN_VIDEO_HEIGHT - THUMBNAIL_MARGIN * 2, Qt::SmoothTransformation);
-            std::lock_guard lk(thumbnail_lock);
-            thumbnails[thumb.getTimestampEof()] = pm;
-          }
-        } else if ((*ev)->which == cereal::Event::Which::CONTROLS_STATE) {
-          auto cs = (*ev)->event.getControlsState();
-          if (cs.getAlertType().size() > 0 && cs.getAlertText1().size() > 0) {
-            std::lock_guard lk(thumbnail_lock);
-            alerts.emplace((*ev)->mono_time, AlertInfo{cs.getAlertStatus(), cs.getAlertText1().cStr(), cs.getAlertText2().cStr()});
-          }
-        }
+  std::vector<std::pair<int, std::string>> qlogs;
+  for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
+    if (!it->second.qlog.isEmpty()) {
+      qlogs.push_back({it->first, it->second.qlog.toStdString()});
+    }
+  }
+  QtConcurrent::blockingMap(qlogs, [this](auto &qlog) { parseSegment(qlog.first, qlog.second); });
+}
+
+void Slider::parseSegment(int seg_num, const std::string &qlog) {
+  if (abort_parse_qlog) return;
+
+  LogReader log;
+  if (!log.load(qlog, &abort_parse_qlog, {cereal::Event::Which::THUMBNAIL, cereal::Event::Which::CONTROLS_STATE}, true, 0, 3)) return;
+
+  if (seg_num == can->route()->segments().rbegin()->first && !log.events.empty()) {
+    double max_time = (*(log.events.rbegin()))->mono_time / 1e9 - can->routeStartTime();
+    emit updateMaximumTime(max_time);
+  }
+  for (auto ev = log.events.cbegin(); ev != log.events.cend() && !abort_parse_qlog; ++ev) {
+    if ((*ev)->which == cereal::Event::Which::THUMBNAIL) {
+      // only keep the compressed image, it's decoded when hovered.
+      auto thumb = (*ev)->event.getThumbnail();
+      auto data = thumb.getThumbnail();
+      QByteArray jpeg((const char *)data.begin(), data.size());
+      std::lock_guard lk(thumbnail_lock);
+      thumbnails[thumb.getTimestampEof()] = jpeg;
+    } else if ((*ev)->which == cereal::Event::Which::CONTROLS_STATE) {
+      auto cs = (*ev)->event.getControlsState();
+      if (cs.getAlertType().size() > 0 && cs.getAlertText1().size() > 0) {
+        std::lock_guard lk(thumbnail_lock);
+        alerts.emplace((*ev)->mono_time, AlertInfo{cs.getAlertStatus(), cs.getAlertText1().cStr(), cs.getAlertText2().cStr()});
       }
     }
   }
 }
 
+void Slider::decodeThumbnail(uint64_t ts, const QByteArray &jpeg) {
+  decoding_thumbnails.insert(ts);
+  QtConcurrent::run(&decode_pool, [this, ts, jpeg]() {
+    QImage img;
+    // skip thumbnails the mouse has already moved away from.
+    if (ts == hover_thumbnail_ts && img.loadFromData(jpeg, "jpeg")) {
+      img = img.scaledToHeight(MIN_VIDEO_HEIGHT - THUMBNAIL_MARGIN * 2, Qt::SmoothTransformation);
+    }
+    QMetaObject::invokeMethod(this, [this, ts, img]() {
+      decoding_thumbnails.remove(ts);
+      if (!img.isNull()) {
+        thumbnail_cache.insert(ts, new QPixmap(QPixmap::fromImage(img)));
+        if (hover_pos >= 0 && ts == hover_thumbnail_ts) {
+          showThumbnail(hover_pos);
+        }
+      }
+    }, Qt::QueuedConnection);
+  });
+}
+
 void Slider::sliderChange(QAbstractSlider::SliderChange change) {
   if (change == QAbstractSlider::SliderValueChange) {
     int x = width() * ((value() - minimum()) / double(maximum() - minimum()));
@@ -248,15 +282,27 @@ void Slider::mousePressEvent(QMouseEvent *e) {
 }
 
 void Slider::mouseMoveEvent(QMouseEvent *e) {
+  hover_pos = std::clamp(e->pos().x(), 0, width());
+  showThumbnail(hover_pos);
+  QSlider::mouseMoveEvent(e);
+}
+
+void Slider::showThumbnail(int pos) {
   QPixmap thumb;
   AlertInfo alert;
-  int pos = std::clamp(e->pos().x(), 0, width());
   double seconds = (minimum() + pos * ((maximum() - minimum()) / (double)width())) / 1000.0;
   {
     std::lock_guard lk(thumbnail_lock);
     uint64_t mono_time = (seconds + can->routeStartTime()) * 1e9;
-    auto it = thumbnails.lowerBound(mono_time);
-    if (it != thumbnails.end()) thumb = it.value();
+    auto it = thumbnails.lower_bound(mono_time);
+    if (it != thumbnails.end()) {
+      hover_thumbnail_ts = it->first;
+      if (QPixmap *pm = thumbnail_cache.object(it->first)) {
+        thumb = *pm;
+      } else if (!decoding_thumbnails.contains(it->first)) {
+        decodeThumbnail(it->first, it->second);
+      }
+    }
     auto alert_it = alerts.lower_bound(mono_time);
     if (alert_it != alerts.end() && (alert_it->first - mono_time) < 1e9) {
       alert = alert_it->second;
@@ -265,7 +311,6 @@ void Slider::mouseMoveEvent(QMouseEvent *e) {
   int x = std::clamp(pos - thumb.width() / 2, THUMBNAIL_MARGIN, rect().right() - thumb.width() - THUMBNAIL_MARGIN);
   int y = -thumb.height();
   thumbnail_label.showPixmap(mapToParent({x, y}), utils::formatSeconds(seconds), thumb, alert);
-  QSlider::mouseMoveEvent(e);
 }
 
 bool Slider::event(QEvent *event) {
@@ -275,6 +320,7 @@ bool Slider::event(QEvent *event) {
     case QEvent::FocusIn:
     case QEvent::FocusOut:
     case QEvent::Leave:
+      hover_pos = -1;
       thumbnail_label.hide();
       break;
     default:
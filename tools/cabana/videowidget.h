@@ -3,10 +3,13 @@
 #include <atomic>
 #include <mutex>
 
+#include <QCache>
 #include <QFuture>
 #include <QLabel>
 #include <QPushButton>
+#include <QSet>
 #include <QSlider>
+#include <QThreadPool>
 
 #include "selfdrive/ui/qt/widgets/cameraview.h"
 #include "tools/cabana/streams/abstractstream.h"
@@ -45,16 +48,24 @@ private:
   void sliderChange(QAbstractSlider::SliderChange change) override;
   void paintEvent(QPaintEvent *ev) override;
   void parseQLog();
+  void parseSegment(int seg_num, const std::string &qlog);
+  void showThumbnail(int pos);
+  void decodeThumbnail(uint64_t ts, const QByteArray &jpeg);
 
   double max_sec = 0;
   int slider_x = -1;
+  int hover_pos = -1;
   std::vector<std::tuple<int, int, TimelineType>> timeline;
   std::mutex thumbnail_lock;
   std::atomic<bool> abort_parse_qlog = false;
-  QMap<uint64_t, QPixmap> thumbnails;
+  std::map<uint64_t, QByteArray> thumbnails;  // jpeg data, decoded on hover
   std::map<uint64_t, AlertInfo> alerts;
   std::unique_ptr<QFuture<void>> qlog_future;
   InfoLabel thumbnail_label;
+  QCache<uint64_t, QPixmap> thumbnail_cache;
+  QSet<uint64_t> decoding_thumbnails;
+  std::atomic<uint64_t> hover_thumbnail_ts = 0;
+  QThreadPool decode_pool;
   friend class VideoWidget;
 };
 
@@ -1,3 +1,5 @@
+#include <bzlib.h>
+
 #include <chrono>
 #include <thread>
 
@@ -75,6 +77,29 @@ TEST_CASE("LogReader") {
     REQUIRE(log.load((std::byte *)corrupt_content.data(), corrupt_content.size()));
     REQUIRE(log.events.size() > 0);
   }
+  SECTION("concatenated bz2 streams") {
+    // loggerd writes compressed logs as a sequence of streams that end at message boundaries
+    std::string content, compressed;
+    for (int i = 0; i < 10; ++i) {
+      std::string stream;
+      for (int j = 0; j < 100; ++j) {
+        MessageBuilder msg;
+        msg.initEvent().initClocks();
+        auto bytes = msg.toBytes();
+        stream.append((const char *)bytes.begin(), bytes.size());
+      }
+      unsigned int size = stream.size() + stream.size() / 100 + 600;
+      std::string out(size, '\0');
+      REQUIRE(BZ2_bzBuffToBuffCompress(out.data(), &size, stream.data(), stream.size(), 9, 0, 0) == BZ_OK);
+      content += stream;
+      compressed += out.substr(0, size);
+    }
+    REQUIRE(decompressBZ2(compressed) == content);
+
+    LogReader log;
+    REQUIRE(log.load((std::byte *)content.data(), content.size()));
+    REQUIRE(log.events.size() == 1000);
+  }
 }
 
 void read_segment(int n, const SegmentFile &segment_file, uint32_t flags) {
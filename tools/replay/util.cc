@@ -266,27 +266,40 @@ std::string decompressBZ2(const std::byte *in, size_t in_size, std::atomic<bool>
   strm.next_in = (char *)in;
   strm.avail_in = in_size;
   std::string out(in_size * 5, '\0');
+  size_t stream_start = 0;  // loggerd writes a sequence of streams
   do {
-    strm.next_out = (char *)(&out[strm.total_out_lo32]);
-    strm.avail_out = out.size() - strm.total_out_lo32;
+    if (stream_start + strm.total_out_lo32 == out.size()) {
+      out.resize(out.size() * 2);
+    }
+    strm.next_out = (char *)(&out[stream_start + strm.total_out_lo32]);
+    strm.avail_out = out.size() - stream_start - strm.total_out_lo32;
 
     const char *prev_write_pos = strm.next_out;
     bzerror = BZ2_bzDecompress(&strm);
+    if (bzerror == BZ_STREAM_END && strm.avail_in > 0) {
+      // start the next stream
+      stream_start += strm.total_out_lo32;
+      char *next_in = strm.next_in;
+      unsigned int avail_in = strm.avail_in;
+      BZ2_bzDecompressEnd(&strm);
+      strm = {};
+      bzerror = BZ2_bzDecompressInit(&strm, 0, 0);
+      assert(bzerror == BZ_OK);
+      strm.next_in = next_in;
+      strm.avail_in = avail_in;
+      continue;
+    }
     if (bzerror == BZ_OK && prev_write_pos == strm.next_out) {
       // content is corrupt
       bzerror = BZ_STREAM_END;
       rWarning("decompressBZ2 error : content is corrupt");
       break;
     }
-
-    if (bzerror == BZ_OK && strm.avail_in > 0 && strm.avail_out == 0) {
-      out.resize(out.size() * 2);
-    }
   } while (bzerror == BZ_OK && !(abort && *abort));
 
   BZ2_bzDecompressEnd(&strm);
   if (bzerror == BZ_STREAM_END && !(abort && *abort)) {
-    out.resize(strm.total_out_lo32);
+    out.resize(stream_start + strm.total_out_lo32);
     return out;
   }
   return {};